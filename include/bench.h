@@ -0,0 +1,247 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include "format.h"
+#include "game.h"
+#include "generate.h"
+#include "noise.h"
+#include "pool.h"
+#include "serialize.h"
+#include "world.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+// Offline measurements, run from the command line (see main).
+
+static inline double bench_now(void) {
+  struct timespec ts;
+  timespec_get(&ts, TIME_UTC);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// Loads the world in `filename` (either format) fully into `world`.
+static bool bench_load_world(Camera2D *camera, World *world, const char *filename) {
+  size_t size = 0;
+  uint8_t *data = read_file_bytes(filename, &size);
+  if (!data) {
+    printf("failed to open file %s\n", filename);
+    return false;
+  }
+  bool ok = true;
+  if (world_format_is_binary(data, size)) {
+    ok = read_world_from_binary(camera, world, data, size);
+  } else {
+    read_world_from_text(camera, world, (const char *)data);
+  }
+  free(data);
+  return ok;
+}
+
+// Encodes the world in `filename` with each codec on its own and with the
+// encoder picking per chunk, and reports the file size and how long it
+// takes to encode the world and to decode every chunk back.
+bool bench_codecs(const char *filename) {
+  Camera2D camera = {0};
+  World world;
+  world_init(&world);
+  if (!bench_load_world(&camera, &world, filename)) {
+    world_free(&world);
+    return false;
+  }
+  WorldSnapshot snapshot = world_snapshot_take(&world, &camera);
+  printf("%s: %zu chunks\n", filename, snapshot.count);
+
+  static const struct {
+    const char *name;
+    uint32_t codecs;
+  } choices[] = {
+      {"raw", CHUNK_CODEC_BIT(CHUNK_CODEC_RAW)},
+      {"rle", CHUNK_CODEC_BIT(CHUNK_CODEC_RLE)},
+      {"deflate", CHUNK_CODEC_BIT(CHUNK_CODEC_DEFLATE)},
+      {"best", WORLD_CODECS_ALL},
+  };
+  for (size_t c = 0; c < sizeof(choices) / sizeof(choices[0]); ++c) {
+    ByteBuffer buffer = {0};
+    double start = bench_now();
+    world_format_encode(&snapshot, choices[c].codecs, &buffer, NULL);
+    double encoded = bench_now();
+
+    size_t used[CHUNK_CODEC_COUNT] = {0};
+    for (uint32_t i = 0; i < snapshot.count; ++i) {
+      WorldFileEntry entry;
+      Chunk chunk = {0};
+      world_format_parse_entry(buffer.data, buffer.size, i, &entry);
+      world_format_decode_chunk(buffer.data, &entry, &chunk);
+      chunk_free(&chunk);
+      used[entry.codec]++;
+    }
+    double decoded = bench_now();
+
+    printf("  %-8s %10zu bytes  encode %8.3f ms  decode %8.3f ms ", choices[c].name, buffer.size,
+           (encoded - start) * 1e3, (decoded - encoded) * 1e3);
+    for (int codec = 0; codec < CHUNK_CODEC_COUNT; ++codec) {
+      printf(" %s %zu", CHUNK_CODEC_NAMES[codec], used[codec]);
+    }
+    printf("\n");
+    byte_buffer_free(&buffer);
+  }
+  world_snapshot_release(&snapshot);
+  world_free(&world);
+  return true;
+}
+
+// The per-value fscanf reader that read_world_from_text replaced, kept as
+// the reference it is measured and checked against.
+static void bench_read_text_fscanf(Camera2D *camera, World *world, const char *filename) {
+  FILE *file = fopen(filename, "r");
+  if (!file) {
+    printf("failed to open file %s\n", filename);
+    exit(1);
+  }
+  fscanf(file, "Camera %f ", &camera->offset.x);
+  world_clear(world);
+  Rectangle bounds = {0};
+  while (fscanf(file, "Chunk { %f, %f, %f, %f } = {\n", &bounds.x, &bounds.y, &bounds.width, &bounds.height) == 4) {
+    Chunk *chunk = world_insert_chunk(world, world_chunk_x(bounds.x), world_chunk_y(bounds.y), NULL);
+    chunk_init(chunk, bounds);
+    for (int y = 0; y < GRID_Y; ++y) {
+      for (int x = 0; x < GRID_X; ++x) {
+        int block = BLOCK_TYPE_AIR;
+        fscanf(file, "%d, ", &block);
+        chunk_set(chunk, x, y, block);
+      }
+    }
+    chunk_compact(chunk);
+    world_account(world, chunk);
+    fscanf(file, "\n}\n");
+  }
+  fclose(file);
+  world_clear_save_dirty(world);
+}
+
+// True if both worlds hold the same chunks with the same blocks.
+static bool bench_worlds_equal(const World *a, const World *b) {
+  if (a->count != b->count) {
+    return false;
+  }
+  for (size_t i = 0; i < a->capacity; ++i) {
+    const ChunkSlot *slot = &a->slots[i];
+    if (slot->state != CHUNK_SLOT_RESIDENT) {
+      continue;
+    }
+    const Chunk *other = world_find_chunk((World *)b, slot->key.x, slot->key.y);
+    if (!other || memcmp(&slot->chunk->bounds, &other->bounds, sizeof(Rectangle)) != 0) {
+      return false;
+    }
+    for (int y = 0; y < GRID_Y; ++y) {
+      BlockType row[GRID_X], other_row[GRID_X];
+      chunk_get_row(slot->chunk, y, row);
+      chunk_get_row(other, y, other_row);
+      if (memcmp(row, other_row, sizeof(row)) != 0) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// Times the single-pass text reader against the fscanf one on a legacy
+// world and checks that both load the same world.
+bool bench_text(const char *filename) {
+  enum { RUNS = 20 };
+  Camera2D camera = {0}, fscanf_camera = {0};
+  World world, fscanf_world;
+  world_init(&world);
+  world_init(&fscanf_world);
+
+  double start = bench_now();
+  for (int run = 0; run < RUNS; ++run) {
+    bench_read_text_fscanf(&fscanf_camera, &fscanf_world, filename);
+  }
+  double scanned = bench_now();
+  for (int run = 0; run < RUNS; ++run) {
+    read_world_from_text_file(&camera, &world, filename);
+  }
+  double parsed = bench_now();
+
+  bool same = camera.offset.x == fscanf_camera.offset.x && bench_worlds_equal(&world, &fscanf_world);
+  printf("%s: %zu chunks  fscanf %8.3f ms  single pass %8.3f ms  (%.1fx)%s\n", filename, world.count,
+         (scanned - start) * 1e3 / RUNS, (parsed - scanned) * 1e3 / RUNS, (scanned - start) / (parsed - scanned),
+         same ? "" : "  MISMATCH");
+  world_free(&world);
+  world_free(&fscanf_world);
+  return same;
+}
+
+typedef struct {
+  uint64_t seed;
+  uint32_t generator;
+  int width;
+} BenchGenerateJob;
+
+// Generates chunk `index` of a band `width` chunks wide, as exploring does.
+static void bench_generate_task(void *context, size_t index) {
+  const BenchGenerateJob *job = context;
+  Chunk chunk = {0};
+  int cx = (int)(index % (size_t)job->width) - job->width / 2;
+  int cy = (int)(index / (size_t)job->width) - WORLD_LOAD_RADIUS_Y;
+  chunk_generate(&chunk, job->seed, job->generator, cx, cy);
+  chunk_free(&chunk);
+}
+
+// Checks that the SIMD noise kernel matches the scalar one bit for bit and
+// reports how fast each evaluates rows, then how many chunks per second
+// every generator makes, on one thread and on the worker pool.
+bool bench_generate(void) {
+  enum { ROWS = 200000, CHUNKS = 20000 };
+  const uint64_t seed = 0x5EED;
+  GeneratorTerrain terrain = generator_terrain(seed);
+  float scalar[GRID_X], fast[GRID_X];
+  bool same = true;
+  uint64_t key = generator_key(seed, 0, 0, GENERATOR_STREAM_MATERIAL);
+  for (int i = 0; i < ROWS && same; ++i) {
+    int x = (int)(generator_uniform(key, 2 * (uint64_t)i) * 2e6) - 1000000;
+    int y = (int)(generator_uniform(key, 2 * (uint64_t)i + 1) * 2e4) - 10000;
+    noise_row_scalar(&terrain.layers, x, y, GRID_X, scalar);
+    noise_row(&terrain.layers, x, y, GRID_X, fast);
+    same = memcmp(scalar, fast, sizeof(scalar)) == 0;
+  }
+  printf("noise kernel: %s, %s\n", NOISE_SSE2 ? "sse2" : "scalar only", same ? "bit-identical" : "MISMATCH");
+
+  // Keeps the timed loops from being optimized away.
+  volatile float sink = 0.0f;
+  double start = bench_now();
+  for (int i = 0; i < ROWS; ++i) {
+    noise_row_scalar(&terrain.layers, i, i, GRID_X, scalar);
+    sink += scalar[i % GRID_X];
+  }
+  double scalar_time = bench_now() - start;
+  start = bench_now();
+  for (int i = 0; i < ROWS; ++i) {
+    noise_row(&terrain.layers, i, i, GRID_X, fast);
+    sink += fast[i % GRID_X];
+  }
+  double fast_time = bench_now() - start;
+  printf("  rows/s   scalar %10.0f  noise_row %10.0f  (%.1fx)\n", ROWS / scalar_time, ROWS / fast_time,
+         scalar_time / fast_time);
+
+  int width = CHUNKS / (2 * WORLD_LOAD_RADIUS_Y + 1);
+  for (uint32_t generator = GENERATOR_MIN_VERSION; generator <= GENERATOR_VERSION; ++generator) {
+    BenchGenerateJob job = {.seed = seed, .generator = generator, .width = width};
+    size_t count = (size_t)width * (2 * WORLD_LOAD_RADIUS_Y + 1);
+    start = bench_now();
+    for (size_t i = 0; i < count; ++i) {
+      bench_generate_task(&job, i);
+    }
+    double serial = bench_now() - start;
+    start = bench_now();
+    pool_for(count, bench_generate_task, &job);
+    double parallel = bench_now() - start;
+    printf("  generator %u  chunks/s  1 thread %10.0f  %d threads %10.0f\n", generator, count / serial,
+           pool_get()->n_threads + 1, count / parallel);
+  }
+  return same;
+}
+
+#endif
@@ -0,0 +1,111 @@
+#ifndef BLOCK_H
+#define BLOCK_H
+
+#include "game.h"
+#include <stdint.h>
+
+#define BLOCK_ID_COUNT 256
+#define BLOCK_MAX_SOUNDS 16
+
+// Sounds blocks may refer to, by index into BLOCK_SOUND_PATHS.
+enum {
+  BLOCK_SOUND_NONE = -1,
+  BLOCK_SOUND_CRUNCH,
+  BLOCK_SOUND_PLACE,
+};
+
+static const char *BLOCK_SOUND_PATHS[] = {
+    "assets/crunch.wav",
+    "assets/place.wav",
+};
+
+// One entry per block type. This is the only place a new block needs to be
+// described; block_registry_init flattens it into per-property tables.
+typedef struct {
+  BlockType type;
+  const char *name;
+  const char *texture; // NULL for blocks that are never drawn.
+  bool solid;          // Collides with the player.
+  bool opaque;         // Hides what is behind it and blocks sky light.
+  bool replaceable;    // Can be placed into, but not broken.
+  int break_sound;
+  int place_sound;
+  Color color; // Average colour, for overviews such as catalog thumbnails.
+} BlockDefinition;
+
+static const BlockDefinition BLOCK_DEFINITIONS[] = {
+    {BLOCK_TYPE_AIR, "Air", NULL, false, false, true, BLOCK_SOUND_NONE, BLOCK_SOUND_NONE, {102, 191, 255, 255}},
+    {BLOCK_TYPE_GRASS, "Grass", "assets/grass.jpg", true, true, false, BLOCK_SOUND_CRUNCH, BLOCK_SOUND_PLACE,
+     {86, 148, 54, 255}},
+    {BLOCK_TYPE_DIRT, "Dirt", "assets/dirt.jpg", true, true, false, BLOCK_SOUND_CRUNCH, BLOCK_SOUND_PLACE,
+     {121, 85, 58, 255}},
+    {BLOCK_TYPE_STONE, "Stone", "assets/stone.jpg", true, true, false, BLOCK_SOUND_CRUNCH, BLOCK_SOUND_PLACE,
+     {125, 125, 125, 255}},
+};
+
+// Flat property tables indexed by BlockId, so hot loops can do a single
+// load instead of branching on the block type. `texture` indexes
+// `texture_paths` (and the textures main() loads from it); -1 means the
+// block is not drawn. `placeable` lists the blocks offered in the hotbar.
+typedef struct {
+  bool solid[BLOCK_ID_COUNT];
+  bool opaque[BLOCK_ID_COUNT];
+  bool replaceable[BLOCK_ID_COUNT];
+  int16_t texture[BLOCK_ID_COUNT];
+  int16_t break_sound[BLOCK_ID_COUNT];
+  int16_t place_sound[BLOCK_ID_COUNT];
+  const char *name[BLOCK_ID_COUNT];
+  Color color[BLOCK_ID_COUNT];
+
+  const char *texture_paths[BLOCK_ID_COUNT];
+  int n_textures;
+  BlockType placeable[BLOCK_ID_COUNT];
+  int n_placeable;
+} BlockRegistry;
+
+static BlockRegistry block_registry;
+
+void block_registry_init(void) {
+  BlockRegistry *registry = &block_registry;
+  *registry = (BlockRegistry){0};
+  for (int id = 0; id < BLOCK_ID_COUNT; ++id) {
+    registry->texture[id] = -1;
+    registry->break_sound[id] = BLOCK_SOUND_NONE;
+    registry->place_sound[id] = BLOCK_SOUND_NONE;
+    registry->name[id] = "Unknown";
+    registry->color[id] = MAGENTA;
+  }
+
+  for (size_t i = 0; i < sizeof(BLOCK_DEFINITIONS) / sizeof(BLOCK_DEFINITIONS[0]); ++i) {
+    const BlockDefinition *def = &BLOCK_DEFINITIONS[i];
+    BlockId id = (BlockId)def->type;
+    registry->solid[id] = def->solid;
+    registry->opaque[id] = def->opaque;
+    registry->replaceable[id] = def->replaceable;
+    registry->break_sound[id] = def->break_sound;
+    registry->place_sound[id] = def->place_sound;
+    registry->name[id] = def->name;
+    registry->color[id] = def->color;
+    if (def->texture) {
+      registry->texture[id] = registry->n_textures;
+      registry->texture_paths[registry->n_textures++] = def->texture;
+      registry->placeable[registry->n_placeable++] = def->type;
+    }
+  }
+}
+
+static inline bool block_is_solid(BlockType type) { return block_registry.solid[(BlockId)type]; }
+
+static inline bool block_is_opaque(BlockType type) { return block_registry.opaque[(BlockId)type]; }
+
+static inline bool block_is_replaceable(BlockType type) {
+  return block_registry.replaceable[(BlockId)type];
+}
+
+static inline int block_texture(BlockType type) { return block_registry.texture[(BlockId)type]; }
+
+static inline const char *block_name(BlockType type) { return block_registry.name[(BlockId)type]; }
+
+static inline Color block_color(BlockType type) { return block_registry.color[(BlockId)type]; }
+
+#endif
@@ -0,0 +1,314 @@
+#ifndef CATALOG_H
+#define CATALOG_H
+
+#include "format.h"
+#include "game.h"
+#include "serialize.h"
+#include "stream.h"
+#include "world.h"
+#include <dirent.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+// World catalog: what the world selection menu shows for every world in a
+// directory, kept in an index file there so that opening the menu only
+// needs a directory listing and a stat per world. A world is only opened
+// again when its modification time says it changed since it was last
+// scanned.
+//
+//   header     CATALOG_HEADER_SIZE bytes
+//     char magic[4]      "BBCT"
+//     u16  version       CATALOG_VERSION
+//     u8   thumb_width, thumb_height
+//     u32  entry count
+//   entries
+//     u16  name length, then the name
+//     i64  modification time, i64 scan time (seconds since the epoch)
+//     u64  size in bytes
+//     u32  chunk count
+//     i64  last played, 0 if never
+//     u8   thumbnail[thumb_height][thumb_width], block ids
+#define CATALOG_FILE ".catalog"
+#define CATALOG_MAGIC "BBCT"
+#define CATALOG_VERSION 1
+#define CATALOG_HEADER_SIZE 12
+#define CATALOG_NAME_MAX 256
+// Thumbnails show the blocks of the 3x2 chunks around the saved camera.
+#define CATALOG_THUMB_CHUNKS_X 3
+#define CATALOG_THUMB_CHUNKS_Y 2
+#define CATALOG_THUMB_WIDTH (CATALOG_THUMB_CHUNKS_X * GRID_X)
+#define CATALOG_THUMB_HEIGHT (CATALOG_THUMB_CHUNKS_Y * GRID_Y)
+#define CATALOG_ENTRY_SIZE(name_length) (2 + (name_length) + 36 + CATALOG_THUMB_WIDTH * CATALOG_THUMB_HEIGHT)
+
+typedef struct {
+  char name[CATALOG_NAME_MAX];
+  int64_t mtime;
+  int64_t scanned;
+  uint64_t size;
+  uint32_t chunk_count;
+  int64_t last_played;
+  BlockId thumbnail[CATALOG_THUMB_HEIGHT][CATALOG_THUMB_WIDTH];
+} CatalogEntry;
+
+// Entries are sorted most recently played first, then by name.
+typedef struct {
+  char *dir;
+  CatalogEntry *entries;
+  size_t count;
+  size_t capacity;
+} WorldCatalog;
+
+static inline void catalog_path(char *out, size_t size, const char *dir, const char *name) {
+  snprintf(out, size, "%s/%s", dir, name);
+}
+
+// Whether directory entry `name` is a world: its name ends in exactly
+// ".data", which leaves out "x.data.tmp" and other leftovers of saves.
+static inline bool catalog_is_world(const char *name) {
+  size_t length = strlen(name);
+  return length > 5 && length < CATALOG_NAME_MAX && strcmp(name + length - 5, ".data") == 0;
+}
+
+static CatalogEntry *catalog_push(WorldCatalog *catalog) {
+  if (catalog->count == catalog->capacity) {
+    catalog->capacity = catalog->capacity ? catalog->capacity * 2 : 32;
+    catalog->entries = realloc(catalog->entries, catalog->capacity * sizeof(CatalogEntry));
+  }
+  CatalogEntry *entry = &catalog->entries[catalog->count++];
+  *entry = (CatalogEntry){0};
+  return entry;
+}
+
+static CatalogEntry *catalog_find(WorldCatalog *catalog, const char *name) {
+  for (size_t i = 0; i < catalog->count; ++i) {
+    if (strcmp(catalog->entries[i].name, name) == 0) {
+      return &catalog->entries[i];
+    }
+  }
+  return NULL;
+}
+
+static int catalog_compare(const void *a, const void *b) {
+  const CatalogEntry *x = a, *y = b;
+  if (x->last_played != y->last_played) {
+    return x->last_played > y->last_played ? -1 : 1;
+  }
+  return strcmp(x->name, y->name);
+}
+
+// Reads the index in `catalog->dir`. A missing or unreadable index leaves
+// the catalog empty, to be rebuilt by catalog_refresh.
+static void catalog_read(WorldCatalog *catalog) {
+  char path[1024];
+  catalog_path(path, sizeof(path), catalog->dir, CATALOG_FILE);
+  size_t size = 0;
+  uint8_t *data = read_file_bytes(path, &size);
+  if (!data) {
+    return;
+  }
+  if (size >= CATALOG_HEADER_SIZE && memcmp(data, CATALOG_MAGIC, 4) == 0 &&
+      get_u16(data + 4) == CATALOG_VERSION && data[6] == CATALOG_THUMB_WIDTH && data[7] == CATALOG_THUMB_HEIGHT) {
+    uint32_t count = get_u32(data + 8);
+    size_t offset = CATALOG_HEADER_SIZE;
+    for (uint32_t i = 0; i < count && offset + 2 <= size; ++i) {
+      uint16_t length = get_u16(data + offset);
+      if (length >= CATALOG_NAME_MAX || offset + CATALOG_ENTRY_SIZE(length) > size) {
+        break;
+      }
+      const uint8_t *p = data + offset + 2;
+      CatalogEntry *entry = catalog_push(catalog);
+      memcpy(entry->name, p, length);
+      p += length;
+      entry->mtime = (int64_t)get_u64(p);
+      entry->scanned = (int64_t)get_u64(p + 8);
+      entry->size = get_u64(p + 16);
+      entry->chunk_count = get_u32(p + 24);
+      entry->last_played = (int64_t)get_u64(p + 28);
+      memcpy(entry->thumbnail, p + 36, sizeof(entry->thumbnail));
+      offset += CATALOG_ENTRY_SIZE(length);
+    }
+  }
+  free(data);
+}
+
+// Writes the index, going through a temporary file so that a crash never
+// leaves a torn one behind.
+void catalog_write(const WorldCatalog *catalog) {
+  ByteBuffer out = {0};
+  uint8_t *header = byte_buffer_extend(&out, CATALOG_HEADER_SIZE);
+  memcpy(header, CATALOG_MAGIC, 4);
+  put_u16(header + 4, CATALOG_VERSION);
+  header[6] = CATALOG_THUMB_WIDTH;
+  header[7] = CATALOG_THUMB_HEIGHT;
+  put_u32(header + 8, (uint32_t)catalog->count);
+  for (size_t i = 0; i < catalog->count; ++i) {
+    const CatalogEntry *entry = &catalog->entries[i];
+    uint16_t length = (uint16_t)strlen(entry->name);
+    uint8_t *p = byte_buffer_extend(&out, CATALOG_ENTRY_SIZE(length));
+    put_u16(p, length);
+    memcpy(p + 2, entry->name, length);
+    p += 2 + length;
+    put_u64(p, (uint64_t)entry->mtime);
+    put_u64(p + 8, (uint64_t)entry->scanned);
+    put_u64(p + 16, entry->size);
+    put_u32(p + 24, entry->chunk_count);
+    put_u64(p + 28, (uint64_t)entry->last_played);
+    memcpy(p + 36, entry->thumbnail, sizeof(entry->thumbnail));
+  }
+
+  char path[1024], temp[1024];
+  catalog_path(path, sizeof(path), catalog->dir, CATALOG_FILE);
+  snprintf(temp, sizeof(temp), "%s.tmp", path);
+  FILE *file = fopen(temp, "wb");
+  if (file) {
+    bool ok = fwrite(out.data, 1, out.size, file) == out.size;
+    ok = fclose(file) == 0 && ok;
+    if (!ok || rename(temp, path) != 0) {
+      printf("failed to write world catalog %s\n", path);
+      remove(temp);
+    }
+  }
+  byte_buffer_free(&out);
+}
+
+// Modification time and size of world `name`. Region worlds are
+// directories: their level file is rewritten on every save, and their size
+// is that of all their files.
+static bool catalog_stat(const char *dir, const char *name, int64_t *mtime, uint64_t *size) {
+  char path[1024];
+  catalog_path(path, sizeof(path), dir, name);
+  struct stat st;
+  if (stat(path, &st) != 0) {
+    return false;
+  }
+  *mtime = st.st_mtime;
+  *size = st.st_size;
+  if (!S_ISDIR(st.st_mode)) {
+    return true;
+  }
+  char level[1024];
+  catalog_path(level, sizeof(level), path, "level");
+  if (stat(level, &st) != 0) {
+    return false;
+  }
+  *mtime = st.st_mtime;
+  *size = 0;
+  DIR *entries = opendir(path);
+  struct dirent *file;
+  while (entries && (file = readdir(entries)) != NULL) {
+    char file_path[2048];
+    snprintf(file_path, sizeof(file_path), "%s/%s", path, file->d_name);
+    if (stat(file_path, &st) == 0 && S_ISREG(st.st_mode)) {
+      *size += st.st_size;
+    }
+  }
+  if (entries) {
+    closedir(entries);
+  }
+  return true;
+}
+
+// Opens world `name` the way the game does, streamed, to count its chunks
+// and draw its thumbnail from the chunks around the saved camera.
+static void catalog_scan(const char *dir, CatalogEntry *entry) {
+  char path[1024];
+  catalog_path(path, sizeof(path), dir, entry->name);
+  Camera2D camera = {0};
+  World world;
+  world_init(&world);
+  entry->chunk_count = 0;
+  memset(entry->thumbnail, (BlockId)BLOCK_TYPE_AIR, sizeof(entry->thumbnail));
+  if (stream_world_from_file(&camera, &world, path)) {
+    entry->chunk_count = (uint32_t)(world.count + world_stream_pending_chunks(&world));
+    int left = (world_chunk_x(camera.target.x) - CATALOG_THUMB_CHUNKS_X / 2) * GRID_X;
+    int top = (world_chunk_y(camera.target.y) - CATALOG_THUMB_CHUNKS_Y / 2) * GRID_Y;
+    for (int y = 0; y < CATALOG_THUMB_HEIGHT; ++y) {
+      for (int x = 0; x < CATALOG_THUMB_WIDTH; ++x) {
+        entry->thumbnail[y][x] = (BlockId)world_get_block(&world, left + x, top + y);
+      }
+    }
+  }
+  world_free(&world);
+}
+
+// Brings the catalog in line with the worlds in its directory: drops
+// worlds that are gone and scans the ones that are new or changed since
+// they were last scanned. Writes the index back if anything changed.
+void catalog_refresh(WorldCatalog *catalog) {
+  bool changed = false;
+  bool *seen = calloc(catalog->count ? catalog->count : 1, sizeof(bool));
+  size_t known = catalog->count;
+  DIR *dir = opendir(catalog->dir);
+  struct dirent *file;
+  while (dir && (file = readdir(dir)) != NULL) {
+    if (!catalog_is_world(file->d_name)) {
+      continue;
+    }
+    int64_t mtime;
+    uint64_t size;
+    if (!catalog_stat(catalog->dir, file->d_name, &mtime, &size)) {
+      continue;
+    }
+    CatalogEntry *entry = catalog_find(catalog, file->d_name);
+    if (entry && entry - catalog->entries < (ptrdiff_t)known) {
+      seen[entry - catalog->entries] = true;
+    }
+    // A world written in the same second it was scanned may have changed
+    // after the scan, so it is scanned again.
+    if (entry && entry->mtime == mtime && entry->size == size && entry->scanned > mtime) {
+      continue;
+    }
+    if (!entry) {
+      entry = catalog_push(catalog);
+      snprintf(entry->name, sizeof(entry->name), "%s", file->d_name);
+    }
+    entry->mtime = mtime;
+    entry->size = size;
+    entry->scanned = time(NULL);
+    catalog_scan(catalog->dir, entry);
+    changed = true;
+  }
+  if (dir) {
+    closedir(dir);
+  }
+
+  size_t kept = 0;
+  for (size_t i = 0; i < catalog->count; ++i) {
+    if (i >= known || seen[i]) {
+      catalog->entries[kept++] = catalog->entries[i];
+    }
+  }
+  changed = changed || kept != catalog->count;
+  catalog->count = kept;
+  free(seen);
+  qsort(catalog->entries, catalog->count, sizeof(CatalogEntry), catalog_compare);
+  if (changed) {
+    catalog_write(catalog);
+  }
+}
+
+// Loads the catalog of the worlds in `dir` and refreshes it.
+void catalog_open(WorldCatalog *catalog, const char *dir) {
+  *catalog = (WorldCatalog){.dir = strdup(dir)};
+  catalog_read(catalog);
+  catalog_refresh(catalog);
+}
+
+// Records that the world at `index` is being played now.
+void catalog_mark_played(WorldCatalog *catalog, size_t index) {
+  catalog->entries[index].last_played = time(NULL);
+  catalog_write(catalog);
+}
+
+void catalog_free(WorldCatalog *catalog) {
+  free(catalog->entries);
+  free(catalog->dir);
+  *catalog = (WorldCatalog){0};
+}
+
+#endif
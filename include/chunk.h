@@ -0,0 +1,341 @@
+#ifndef CHUNK_H
+#define CHUNK_H
+
+#include "block.h"
+#include "game.h"
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+static inline size_t chunk_palette_capacity(uint8_t bits) { return (size_t)1 << bits; }
+
+static inline size_t chunk_indices_size(uint8_t bits) { return (CHUNK_CELLS * bits + 7) / 8; }
+
+static inline BlockId *chunk_palette(const Chunk *chunk) { return chunk->data; }
+
+static inline uint8_t *chunk_indices(const Chunk *chunk) {
+  return chunk->data + chunk_palette_capacity(chunk->bits);
+}
+
+static inline size_t chunk_data_size(uint8_t bits) {
+  return chunk_palette_capacity(bits) + chunk_indices_size(bits);
+}
+
+// Block data buffers are reference counted so that world snapshots can share
+// them with live chunks; the count sits just before the palette.
+typedef struct {
+  atomic_uint refs;
+  uint32_t size;
+} ChunkDataHeader;
+
+static inline ChunkDataHeader *chunk_data_header(uint8_t *data) {
+  return (ChunkDataHeader *)data - 1;
+}
+
+static uint8_t *chunk_data_alloc(size_t size) {
+  ChunkDataHeader *header = calloc(1, sizeof(ChunkDataHeader) + size);
+  atomic_init(&header->refs, 1);
+  header->size = (uint32_t)size;
+  return (uint8_t *)(header + 1);
+}
+
+static inline uint8_t *chunk_data_retain(uint8_t *data) {
+  if (data) {
+    atomic_fetch_add_explicit(&chunk_data_header(data)->refs, 1, memory_order_relaxed);
+  }
+  return data;
+}
+
+// Safe to call from any thread.
+static inline void chunk_data_release(uint8_t *data) {
+  if (data && atomic_fetch_sub_explicit(&chunk_data_header(data)->refs, 1, memory_order_acq_rel) == 1) {
+    free(chunk_data_header(data));
+  }
+}
+
+// Gives `chunk` a private copy of its block data if a snapshot still shares
+// it. Must be called before any in-place write.
+static inline void chunk_unshare(Chunk *chunk) {
+  if (chunk->data && atomic_load_explicit(&chunk_data_header(chunk->data)->refs, memory_order_acquire) > 1) {
+    size_t size = chunk_data_header(chunk->data)->size;
+    uint8_t *copy = chunk_data_alloc(size);
+    memcpy(copy, chunk->data, size);
+    chunk_data_release(chunk->data);
+    chunk->data = copy;
+  }
+}
+
+static inline unsigned chunk_index_get(const uint8_t *indices, uint8_t bits, int cell) {
+  unsigned bit = (unsigned)cell * bits;
+  return (indices[bit >> 3] >> (bit & 7)) & ((1u << bits) - 1);
+}
+
+static inline void chunk_index_set(uint8_t *indices, uint8_t bits, int cell, unsigned value) {
+  unsigned bit = (unsigned)cell * bits;
+  uint8_t mask = (uint8_t)(((1u << bits) - 1) << (bit & 7));
+  indices[bit >> 3] = (indices[bit >> 3] & ~mask) | (uint8_t)(value << (bit & 7));
+}
+
+static inline bool chunk_is_uniform(const Chunk *chunk) { return chunk->bits == 0; }
+
+static inline BlockType chunk_uniform_type(const Chunk *chunk) {
+  return (BlockType)(int8_t)chunk->uniform;
+}
+
+static void chunk_make_uniform(Chunk *chunk, BlockId id) {
+  chunk_data_release(chunk->data);
+  chunk->data = NULL;
+  chunk->bits = 0;
+  chunk->uniform = id;
+  chunk->palette_size = 1;
+}
+
+static inline void chunk_mark_dirty(Chunk *chunk, uint16_t rows) {
+  for (int i = 0; i < CHUNK_DIRTY_CONSUMERS; ++i) {
+    chunk->dirty_rows[i] |= rows;
+  }
+}
+
+static inline bool chunk_is_dirty(const Chunk *chunk, ChunkDirtyConsumer consumer) {
+  return chunk->dirty_rows[consumer] != 0;
+}
+
+static inline uint16_t chunk_dirty_rows(const Chunk *chunk, ChunkDirtyConsumer consumer) {
+  return chunk->dirty_rows[consumer];
+}
+
+static inline void chunk_clear_dirty(Chunk *chunk, ChunkDirtyConsumer consumer) {
+  chunk->dirty_rows[consumer] = 0;
+}
+
+void chunk_free(Chunk *chunk) {
+  chunk_make_uniform(chunk, (BlockId)BLOCK_TYPE_AIR);
+  free(chunk->mesh);
+  chunk->mesh = NULL;
+}
+
+// Resets `chunk` to all air, with every row dirty. The chunk must be zeroed
+// or previously initialized; any storage it owned is released.
+void chunk_init(Chunk *chunk, Rectangle bounds) {
+  chunk_free(chunk);
+  chunk->bounds = bounds;
+  memset(chunk->heightmap, GRID_Y, sizeof(chunk->heightmap));
+  chunk_mark_dirty(chunk, CHUNK_ALL_ROWS);
+}
+
+// Moves the blocks of `from` into `chunk` and frees `from`. Every row of
+// `chunk` becomes dirty; its mesh and residency bookkeeping stay.
+void chunk_move_blocks(Chunk *chunk, Chunk *from) {
+  chunk_data_release(chunk->data);
+  chunk->bounds = from->bounds;
+  chunk->bits = from->bits;
+  chunk->uniform = from->uniform;
+  chunk->palette_size = from->palette_size;
+  chunk->data = from->data;
+  memcpy(chunk->heightmap, from->heightmap, sizeof(chunk->heightmap));
+  chunk_mark_dirty(chunk, CHUNK_ALL_ROWS);
+  from->data = NULL;
+  chunk_free(from);
+}
+
+// Turns a uniform chunk into a 1-bit palette chunk whose every cell is the
+// old uniform type.
+static void chunk_expand(Chunk *chunk) {
+  chunk->bits = 1;
+  chunk->data = chunk_data_alloc(chunk_data_size(chunk->bits));
+  chunk_palette(chunk)[0] = chunk->uniform;
+  chunk->palette_size = 1;
+}
+
+// Doubles the index width and re-encodes every cell, keeping palette order.
+static void chunk_repack(Chunk *chunk, uint8_t bits) {
+  uint8_t *data = chunk_data_alloc(chunk_data_size(bits));
+  memcpy(data, chunk_palette(chunk), chunk->palette_size);
+  uint8_t *indices = data + chunk_palette_capacity(bits);
+  const uint8_t *old = chunk_indices(chunk);
+  for (int i = 0; i < CHUNK_CELLS; ++i) {
+    chunk_index_set(indices, bits, i, chunk_index_get(old, chunk->bits, i));
+  }
+  chunk_data_release(chunk->data);
+  chunk->data = data;
+  chunk->bits = bits;
+}
+
+static inline BlockType chunk_get(const Chunk *chunk, int x, int y) {
+  if (chunk_is_uniform(chunk)) {
+    return chunk_uniform_type(chunk);
+  }
+  unsigned index = chunk_index_get(chunk_indices(chunk), chunk->bits, y * GRID_X + x);
+  return (BlockType)(int8_t)chunk_palette(chunk)[index];
+}
+
+// Decodes a whole row at once; cheaper than GRID_X calls to chunk_get.
+static inline void chunk_get_row(const Chunk *chunk, int y, BlockType row[GRID_X]) {
+  if (chunk_is_uniform(chunk)) {
+    for (int x = 0; x < GRID_X; ++x) {
+      row[x] = chunk_uniform_type(chunk);
+    }
+    return;
+  }
+  const BlockId *palette = chunk_palette(chunk);
+  const uint8_t *indices = chunk_indices(chunk);
+  for (int x = 0; x < GRID_X; ++x) {
+    row[x] = (BlockType)(int8_t)palette[chunk_index_get(indices, chunk->bits, y * GRID_X + x)];
+  }
+}
+
+// The single write path for blocks: also marks row `y` dirty for every
+// ChunkDirtyConsumer when the block actually changes.
+static inline void chunk_set(Chunk *chunk, int x, int y, BlockType type) {
+  BlockId id = (BlockId)type;
+  if (chunk_is_uniform(chunk)) {
+    if (id == chunk->uniform) {
+      return;
+    }
+    chunk_expand(chunk);
+  } else if (chunk_palette(chunk)[chunk_index_get(chunk_indices(chunk), chunk->bits, y * GRID_X + x)] == id) {
+    return;
+  }
+  chunk_unshare(chunk);
+  BlockId *palette = chunk_palette(chunk);
+  unsigned index = 0;
+  while (index < chunk->palette_size && palette[index] != id) {
+    index++;
+  }
+  if (index == chunk->palette_size) {
+    if (index == chunk_palette_capacity(chunk->bits)) {
+      chunk_repack(chunk, chunk->bits * 2);
+      palette = chunk_palette(chunk);
+    }
+    palette[index] = id;
+    chunk->palette_size++;
+  }
+  chunk_index_set(chunk_indices(chunk), chunk->bits, y * GRID_X + x, index);
+  chunk_mark_dirty(chunk, (uint16_t)(1u << y));
+
+  uint8_t *top = &chunk->heightmap[x];
+  if (block_is_solid(type)) {
+    if (y < *top) {
+      *top = y;
+    }
+  } else if (y == *top) {
+    do {
+      (*top)++;
+    } while (*top < GRID_Y && !block_is_solid(chunk_get(chunk, x, *top)));
+  }
+}
+
+// Row of the topmost solid block in column `x`, or GRID_Y if the column is
+// empty. O(1): kept up to date by chunk_set.
+static inline int chunk_column_top(const Chunk *chunk, int x) { return chunk->heightmap[x]; }
+
+// Drops palette entries no cell refers to any more, and collapses the chunk
+// back to the uniform representation when a single type is left. Call after
+// bulk writes such as generation or loading.
+void chunk_compact(Chunk *chunk) {
+  if (chunk_is_uniform(chunk)) {
+    return;
+  }
+  bool used[256] = {0};
+  const uint8_t *old = chunk_indices(chunk);
+  for (int i = 0; i < CHUNK_CELLS; ++i) {
+    used[chunk_index_get(old, chunk->bits, i)] = true;
+  }
+
+  uint8_t remap[256];
+  BlockId palette[256];
+  unsigned n_used = 0;
+  for (unsigned i = 0; i < chunk->palette_size; ++i) {
+    if (used[i]) {
+      remap[i] = n_used;
+      palette[n_used++] = chunk_palette(chunk)[i];
+    }
+  }
+  if (n_used == 1) {
+    chunk_make_uniform(chunk, palette[0]);
+    return;
+  }
+  if (n_used == chunk->palette_size) {
+    return;
+  }
+
+  uint8_t bits = 1;
+  while (chunk_palette_capacity(bits) < n_used) {
+    bits *= 2;
+  }
+  uint8_t *data = chunk_data_alloc(chunk_data_size(bits));
+  memcpy(data, palette, n_used);
+  uint8_t *indices = data + chunk_palette_capacity(bits);
+  for (int i = 0; i < CHUNK_CELLS; ++i) {
+    chunk_index_set(indices, bits, i, remap[chunk_index_get(old, chunk->bits, i)]);
+  }
+  chunk_data_release(chunk->data);
+  chunk->data = data;
+  chunk->bits = bits;
+  chunk->palette_size = n_used;
+}
+
+// Copies every block id of `chunk` out in row-major order.
+void chunk_store_cells(const Chunk *chunk, BlockId cells[CHUNK_CELLS]) {
+  if (chunk_is_uniform(chunk)) {
+    memset(cells, chunk->uniform, CHUNK_CELLS);
+    return;
+  }
+  const BlockId *palette = chunk_palette(chunk);
+  const uint8_t *indices = chunk_indices(chunk);
+  for (int i = 0; i < CHUNK_CELLS; ++i) {
+    cells[i] = palette[chunk_index_get(indices, chunk->bits, i)];
+  }
+}
+
+// Replaces every block of `chunk` with the row-major `cells` in one pass,
+// building the palette, indices and heightmap directly instead of going
+// through chunk_set per cell. All rows end up dirty.
+void chunk_load_cells(Chunk *chunk, const BlockId cells[CHUNK_CELLS]) {
+  bool seen[256] = {0};
+  uint8_t lookup[256];
+  BlockId palette[256];
+  unsigned n_used = 0;
+  for (int i = 0; i < CHUNK_CELLS; ++i) {
+    if (!seen[cells[i]]) {
+      seen[cells[i]] = true;
+      lookup[cells[i]] = n_used;
+      palette[n_used++] = cells[i];
+    }
+  }
+
+  chunk_init(chunk, chunk->bounds);
+  if (n_used == 1) {
+    chunk->uniform = palette[0];
+  } else {
+    uint8_t bits = 1;
+    while (chunk_palette_capacity(bits) < n_used) {
+      bits *= 2;
+    }
+    chunk->bits = bits;
+    chunk->palette_size = n_used;
+    chunk->data = chunk_data_alloc(chunk_data_size(bits));
+    memcpy(chunk->data, palette, n_used);
+    uint8_t *indices = chunk_indices(chunk);
+    for (int i = 0; i < CHUNK_CELLS; ++i) {
+      chunk_index_set(indices, bits, i, lookup[cells[i]]);
+    }
+  }
+
+  for (int x = 0; x < GRID_X; ++x) {
+    int y = 0;
+    while (y < GRID_Y && !block_is_solid((BlockType)(int8_t)cells[y * GRID_X + x])) {
+      y++;
+    }
+    chunk->heightmap[x] = y;
+  }
+}
+
+static inline size_t chunk_memory_usage(const Chunk *chunk) {
+  return sizeof(Chunk) + (chunk->data ? chunk_data_size(chunk->bits) : 0) +
+         (chunk->mesh ? sizeof(ChunkMesh) : 0);
+}
+
+#endif
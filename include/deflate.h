@@ -0,0 +1,404 @@
+#ifndef DEFLATE_H
+#define DEFLATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Raw DEFLATE (RFC 1951) for chunk payloads, which are at most a few
+// hundred bytes. Both directions work in caller-provided buffers and never
+// allocate or log, so they are safe to run on the worker pool. The decoder
+// reads any raw DEFLATE stream, including those written by raylib's
+// CompressData in older saves. The encoder writes a single block of fixed
+// Huffman codes with greedy LZ77 matching: chunks are too small for a code
+// table of their own to pay off.
+
+#define DEFLATE_MAX_BITS 15
+#define DEFLATE_MAX_LENGTH_CODES 288
+#define DEFLATE_MAX_DISTANCE_CODES 30
+#define DEFLATE_MIN_MATCH 3
+#define DEFLATE_MAX_MATCH 258
+// Longest hash chain the encoder follows for a match.
+#define DEFLATE_MAX_CHAIN 16
+// Longest input the encoder takes.
+#define DEFLATE_MAX_INPUT 1024
+
+static const uint16_t DEFLATE_LENGTH_BASE[29] = {3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+                                                 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const uint8_t DEFLATE_LENGTH_EXTRA[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+                                                 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const uint16_t DEFLATE_DISTANCE_BASE[30] = {1,   2,   3,   4,   5,   7,    9,    13,   17,   25,
+                                                   33,  49,  65,  97,  129, 193,  257,  385,  513,  769,
+                                                   1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const uint8_t DEFLATE_DISTANCE_EXTRA[30] = {0, 0, 0, 0, 1, 1, 2, 2,  3,  3,  4,  4,  5,  5,  6,
+                                                   6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+// Canonical Huffman code: how many codes have each length, and the symbols
+// in code order.
+typedef struct {
+  uint16_t count[DEFLATE_MAX_BITS + 1];
+  uint16_t symbol[DEFLATE_MAX_LENGTH_CODES];
+} DeflateHuffman;
+
+typedef struct {
+  const uint8_t *in;
+  size_t in_size;
+  size_t in_pos;
+  uint32_t bits;
+  int n_bits;
+  bool failed; // Read past the end of the input.
+  uint8_t *out;
+  size_t out_size;
+  size_t out_pos;
+} DeflateReader;
+
+static uint32_t deflate_read_bits(DeflateReader *s, int need) {
+  uint32_t value = s->bits;
+  while (s->n_bits < need) {
+    if (s->in_pos == s->in_size) {
+      s->failed = true;
+      return 0;
+    }
+    value |= (uint32_t)s->in[s->in_pos++] << s->n_bits;
+    s->n_bits += 8;
+  }
+  s->bits = value >> need;
+  s->n_bits -= need;
+  return value & ((1u << need) - 1);
+}
+
+// Builds `h` from the code length of each of `n` symbols. Returns 0 for a
+// complete code, a positive number for an incomplete one and -1 for an
+// over-subscribed one.
+static int deflate_build(DeflateHuffman *h, const uint8_t *lengths, int n) {
+  memset(h->count, 0, sizeof(h->count));
+  for (int i = 0; i < n; ++i) {
+    h->count[lengths[i]]++;
+  }
+  if (h->count[0] == n) {
+    return 0;
+  }
+  int left = 1;
+  for (int len = 1; len <= DEFLATE_MAX_BITS; ++len) {
+    left = (left << 1) - h->count[len];
+    if (left < 0) {
+      return -1;
+    }
+  }
+  uint16_t offsets[DEFLATE_MAX_BITS + 1];
+  offsets[1] = 0;
+  for (int len = 1; len < DEFLATE_MAX_BITS; ++len) {
+    offsets[len + 1] = offsets[len] + h->count[len];
+  }
+  for (int i = 0; i < n; ++i) {
+    if (lengths[i]) {
+      h->symbol[offsets[lengths[i]]++] = i;
+    }
+  }
+  return left;
+}
+
+// Reads one symbol coded with `h`, or returns -1.
+static int deflate_read_symbol(DeflateReader *s, const DeflateHuffman *h) {
+  int code = 0, first = 0, index = 0;
+  for (int len = 1; len <= DEFLATE_MAX_BITS; ++len) {
+    code |= (int)deflate_read_bits(s, 1);
+    if (s->failed) {
+      return -1;
+    }
+    int count = h->count[len];
+    if (code - count < first) {
+      return h->symbol[index + (code - first)];
+    }
+    index += count;
+    first = (first + count) << 1;
+    code <<= 1;
+  }
+  return -1;
+}
+
+// Decodes the literals and matches of one block.
+static bool deflate_read_codes(DeflateReader *s, const DeflateHuffman *lengths, const DeflateHuffman *distances) {
+  for (;;) {
+    int symbol = deflate_read_symbol(s, lengths);
+    if (symbol < 0) {
+      return false;
+    }
+    if (symbol < 256) {
+      if (s->out_pos == s->out_size) {
+        return false;
+      }
+      s->out[s->out_pos++] = (uint8_t)symbol;
+      continue;
+    }
+    if (symbol == 256) {
+      return true;
+    }
+    symbol -= 257;
+    if (symbol >= 29) {
+      return false;
+    }
+    size_t length = DEFLATE_LENGTH_BASE[symbol] + deflate_read_bits(s, DEFLATE_LENGTH_EXTRA[symbol]);
+    symbol = deflate_read_symbol(s, distances);
+    if (symbol < 0 || symbol >= DEFLATE_MAX_DISTANCE_CODES) {
+      return false;
+    }
+    size_t distance = DEFLATE_DISTANCE_BASE[symbol] + deflate_read_bits(s, DEFLATE_DISTANCE_EXTRA[symbol]);
+    if (s->failed || distance > s->out_pos || length > s->out_size - s->out_pos) {
+      return false;
+    }
+    for (size_t i = 0; i < length; ++i, ++s->out_pos) {
+      s->out[s->out_pos] = s->out[s->out_pos - distance];
+    }
+  }
+}
+
+static bool deflate_read_stored(DeflateReader *s) {
+  s->bits = 0;
+  s->n_bits = 0;
+  if (s->in_size - s->in_pos < 4) {
+    return false;
+  }
+  const uint8_t *p = s->in + s->in_pos;
+  size_t length = p[0] | p[1] << 8;
+  if ((size_t)(p[2] | p[3] << 8) != (~length & 0xFFFF)) {
+    return false;
+  }
+  s->in_pos += 4;
+  if (length > s->in_size - s->in_pos || length > s->out_size - s->out_pos) {
+    return false;
+  }
+  memcpy(s->out + s->out_pos, s->in + s->in_pos, length);
+  s->in_pos += length;
+  s->out_pos += length;
+  return true;
+}
+
+static void deflate_fixed_lengths(uint8_t lengths[DEFLATE_MAX_LENGTH_CODES + DEFLATE_MAX_DISTANCE_CODES]) {
+  int i = 0;
+  for (; i < 144; ++i) {
+    lengths[i] = 8;
+  }
+  for (; i < 256; ++i) {
+    lengths[i] = 9;
+  }
+  for (; i < 280; ++i) {
+    lengths[i] = 7;
+  }
+  for (; i < DEFLATE_MAX_LENGTH_CODES; ++i) {
+    lengths[i] = 8;
+  }
+  for (; i < DEFLATE_MAX_LENGTH_CODES + DEFLATE_MAX_DISTANCE_CODES; ++i) {
+    lengths[i] = 5;
+  }
+}
+
+// Reads the code tables of a block with dynamic Huffman codes.
+static bool deflate_read_tables(DeflateReader *s, DeflateHuffman *lengths, DeflateHuffman *distances) {
+  static const uint8_t ORDER[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+  int n_lengths = (int)deflate_read_bits(s, 5) + 257;
+  int n_distances = (int)deflate_read_bits(s, 5) + 1;
+  int n_codes = (int)deflate_read_bits(s, 4) + 4;
+  if (s->failed || n_lengths > 286 || n_distances > DEFLATE_MAX_DISTANCE_CODES) {
+    return false;
+  }
+  uint8_t code_lengths[DEFLATE_MAX_LENGTH_CODES + DEFLATE_MAX_DISTANCE_CODES] = {0};
+  for (int i = 0; i < n_codes; ++i) {
+    code_lengths[ORDER[i]] = (uint8_t)deflate_read_bits(s, 3);
+  }
+  DeflateHuffman codes;
+  if (s->failed || deflate_build(&codes, code_lengths, 19) != 0) {
+    return false;
+  }
+  int n = 0;
+  while (n < n_lengths + n_distances) {
+    int symbol = deflate_read_symbol(s, &codes);
+    if (symbol < 0) {
+      return false;
+    }
+    if (symbol < 16) {
+      code_lengths[n++] = (uint8_t)symbol;
+      continue;
+    }
+    uint8_t length = 0;
+    int repeat;
+    if (symbol == 16) {
+      if (n == 0) {
+        return false;
+      }
+      length = code_lengths[n - 1];
+      repeat = 3 + (int)deflate_read_bits(s, 2);
+    } else if (symbol == 17) {
+      repeat = 3 + (int)deflate_read_bits(s, 3);
+    } else {
+      repeat = 11 + (int)deflate_read_bits(s, 7);
+    }
+    if (s->failed || n + repeat > n_lengths + n_distances) {
+      return false;
+    }
+    while (repeat--) {
+      code_lengths[n++] = length;
+    }
+  }
+  // Without an end-of-block code the block could never end. Incomplete
+  // codes are only allowed when they have a single symbol.
+  if (code_lengths[256] == 0) {
+    return false;
+  }
+  int left = deflate_build(lengths, code_lengths, n_lengths);
+  if (left < 0 || (left > 0 && n_lengths - lengths->count[0] != 1)) {
+    return false;
+  }
+  left = deflate_build(distances, code_lengths + n_lengths, n_distances);
+  return left >= 0 && !(left > 0 && n_distances - distances->count[0] != 1);
+}
+
+// Decodes the raw DEFLATE stream `in` into `out`. Returns false unless it is
+// well formed and expands to exactly `size` bytes.
+bool deflate_decode(const uint8_t *in, size_t length, uint8_t *out, size_t size) {
+  DeflateReader s = {.in = in, .in_size = length, .out = out, .out_size = size};
+  bool last;
+  do {
+    last = deflate_read_bits(&s, 1);
+    uint32_t type = deflate_read_bits(&s, 2);
+    bool ok = false;
+    if (s.failed) {
+      return false;
+    } else if (type == 0) {
+      ok = deflate_read_stored(&s);
+    } else if (type == 1) {
+      uint8_t lengths[DEFLATE_MAX_LENGTH_CODES + DEFLATE_MAX_DISTANCE_CODES];
+      deflate_fixed_lengths(lengths);
+      DeflateHuffman literals, distances;
+      deflate_build(&literals, lengths, DEFLATE_MAX_LENGTH_CODES);
+      deflate_build(&distances, lengths + DEFLATE_MAX_LENGTH_CODES, DEFLATE_MAX_DISTANCE_CODES);
+      ok = deflate_read_codes(&s, &literals, &distances);
+    } else if (type == 2) {
+      DeflateHuffman literals, distances;
+      ok = deflate_read_tables(&s, &literals, &distances) && deflate_read_codes(&s, &literals, &distances);
+    }
+    if (!ok) {
+      return false;
+    }
+  } while (!last);
+  return s.out_pos == size;
+}
+
+typedef struct {
+  uint8_t *out;
+  size_t capacity;
+  size_t size;
+  uint32_t bits;
+  int n_bits;
+  bool full; // Ran out of room.
+} DeflateWriter;
+
+static void deflate_write_bits(DeflateWriter *w, uint32_t value, int count) {
+  if (w->full) {
+    return;
+  }
+  w->bits |= value << w->n_bits;
+  w->n_bits += count;
+  while (w->n_bits >= 8) {
+    if (w->size == w->capacity) {
+      w->full = true;
+      return;
+    }
+    w->out[w->size++] = (uint8_t)w->bits;
+    w->bits >>= 8;
+    w->n_bits -= 8;
+  }
+}
+
+// Huffman codes are sent most significant bit first.
+static void deflate_write_code(DeflateWriter *w, uint32_t code, int length) {
+  uint32_t reversed = 0;
+  for (int i = 0; i < length; ++i) {
+    reversed = reversed << 1 | (code >> i & 1);
+  }
+  deflate_write_bits(w, reversed, length);
+}
+
+static void deflate_write_literal(DeflateWriter *w, int symbol) {
+  if (symbol < 144) {
+    deflate_write_code(w, 0x30 + symbol, 8);
+  } else if (symbol < 256) {
+    deflate_write_code(w, 0x190 + symbol - 144, 9);
+  } else if (symbol < 280) {
+    deflate_write_code(w, symbol - 256, 7);
+  } else {
+    deflate_write_code(w, 0xC0 + symbol - 280, 8);
+  }
+}
+
+static void deflate_write_match(DeflateWriter *w, size_t length, size_t distance) {
+  int code = 28;
+  while (DEFLATE_LENGTH_BASE[code] > length) {
+    code--;
+  }
+  deflate_write_literal(w, 257 + code);
+  deflate_write_bits(w, (uint32_t)(length - DEFLATE_LENGTH_BASE[code]), DEFLATE_LENGTH_EXTRA[code]);
+  code = DEFLATE_MAX_DISTANCE_CODES - 1;
+  while (DEFLATE_DISTANCE_BASE[code] > distance) {
+    code--;
+  }
+  deflate_write_code(w, code, 5);
+  deflate_write_bits(w, (uint32_t)(distance - DEFLATE_DISTANCE_BASE[code]), DEFLATE_DISTANCE_EXTRA[code]);
+}
+
+static inline uint8_t deflate_hash(const uint8_t *p) { return (uint8_t)((p[0] * 33u + p[1]) * 33u + p[2]); }
+
+// Encodes the `length` bytes of `in`, at most DEFLATE_MAX_INPUT, into `out`.
+// Returns the size of the stream, or 0 if it does not fit in `capacity`
+// bytes.
+size_t deflate_encode(const uint8_t *in, size_t length, uint8_t *out, size_t capacity) {
+  if (length > DEFLATE_MAX_INPUT) {
+    return 0;
+  }
+  DeflateWriter w = {.out = out, .capacity = capacity};
+  deflate_write_bits(&w, 1, 1); // Last block,
+  deflate_write_bits(&w, 1, 2); // with fixed codes.
+
+  // Most recent position for each hash, and the one before it with the
+  // same hash; -1 where there is none.
+  int32_t head[256];
+  int32_t prev[DEFLATE_MAX_INPUT];
+  memset(head, 0xFF, sizeof(head));
+  size_t i = 0;
+  while (i < length && !w.full) {
+    size_t best_length = 0, best_distance = 0;
+    if (length - i >= DEFLATE_MIN_MATCH) {
+      size_t limit = length - i < DEFLATE_MAX_MATCH ? length - i : DEFLATE_MAX_MATCH;
+      int32_t candidate = head[deflate_hash(in + i)];
+      for (int chain = 0; candidate >= 0 && chain < DEFLATE_MAX_CHAIN; ++chain) {
+        size_t n = 0;
+        while (n < limit && in[candidate + n] == in[i + n]) {
+          n++;
+        }
+        if (n > best_length) {
+          best_length = n;
+          best_distance = i - (size_t)candidate;
+        }
+        candidate = prev[candidate];
+      }
+    }
+    size_t step = best_length >= DEFLATE_MIN_MATCH ? best_length : 1;
+    if (step > 1) {
+      deflate_write_match(&w, best_length, best_distance);
+    } else {
+      deflate_write_literal(&w, in[i]);
+    }
+    for (; step > 0; --step, ++i) {
+      if (length - i >= DEFLATE_MIN_MATCH) {
+        uint8_t hash = deflate_hash(in + i);
+        prev[i] = head[hash];
+        head[hash] = (int32_t)i;
+      }
+    }
+  }
+  deflate_write_literal(&w, 256);
+  deflate_write_bits(&w, 0, 7); // Flush the last byte.
+  return w.full ? 0 : w.size;
+}
+
+#endif
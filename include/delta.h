@@ -0,0 +1,279 @@
+#ifndef DELTA_H
+#define DELTA_H
+
+#include "chunk.h"
+#include "format.h"
+#include "game.h"
+#include "generate.h"
+#include "pool.h"
+#include "world.h"
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// Delta world files record the generator a world was made with and, for
+// every chunk that differs from what that generator produces, how it
+// differs. Chunks that were never edited are not stored at all: they are
+// generated again when the player gets near them, exactly as the first
+// time. All integers are little-endian.
+//
+//   header     DELTA_HEADER_SIZE bytes
+//     char magic[4]      "BBDT"
+//     u16  version       DELTA_VERSION
+//     u8   grid_x, grid_y
+//     u32  generator     generator version the chunks were generated with
+//     u64  seed
+//     f32  camera offset x, y, camera target x, y
+//     u32  chunk count
+//   chunks
+//     i32  cx, cy
+//     u8   kind          DELTA_CHUNK_EDITS, or the ChunkCodec of a whole chunk
+//     u16  payload length
+//     payload            DELTA_CHUNK_EDITS: a (u8 cell, u8 block id) pair per
+//                        changed cell, cell = y * GRID_X + x; otherwise the
+//                        chunk's blocks encoded as in format.h
+//
+// A chunk is stored whole when that is smaller than its edits, e.g. when it
+// was loaded from a world made by another generator.
+#define DELTA_MAGIC "BBDT"
+#define DELTA_VERSION 1
+#define DELTA_HEADER_SIZE 40
+#define DELTA_RECORD_SIZE 11
+#define DELTA_CHUNK_EDITS 0xFF
+static_assert(CHUNK_CELLS <= 256, "delta edits address cells with one byte");
+
+static inline bool delta_format_is_delta(const uint8_t *data, size_t size) {
+  return size >= 4 && memcmp(data, DELTA_MAGIC, 4) == 0;
+}
+
+// How one chunk differs from what generation gives. A chunk is only stored
+// whole when that is smaller than its edits, so the payload never exceeds a
+// raw chunk.
+typedef struct {
+  bool changed;
+  uint8_t kind; // DELTA_CHUNK_EDITS or a ChunkCodec.
+  uint16_t length;
+  uint8_t payload[CHUNK_CELLS];
+} DeltaRecord;
+
+// Compares `chunk` at `coord` with what generator `generator` gives and
+// fills in `record` with the difference.
+static void delta_diff_chunk(const Chunk *chunk, ChunkCoord coord, uint64_t seed, uint32_t generator,
+                             DeltaRecord *record) {
+  Chunk generated = {0};
+  chunk_generate(&generated, seed, generator, coord.x, coord.y);
+  BlockId cells[CHUNK_CELLS], expected[CHUNK_CELLS];
+  chunk_store_cells(chunk, cells);
+  chunk_store_cells(&generated, expected);
+  chunk_free(&generated);
+  uint8_t edits[2 * CHUNK_CELLS];
+  size_t length = 0;
+  for (int i = 0; i < CHUNK_CELLS; ++i) {
+    if (cells[i] != expected[i]) {
+      edits[length++] = (uint8_t)i;
+      edits[length++] = cells[i];
+    }
+  }
+  record->changed = length > 0;
+  if (!record->changed) {
+    return;
+  }
+
+  ChunkPayload whole;
+  chunk_payload_encode(chunk, WORLD_CODECS_ALL, &whole);
+  if (length < whole.length) {
+    record->kind = DELTA_CHUNK_EDITS;
+    record->length = (uint16_t)length;
+    memcpy(record->payload, edits, length);
+  } else {
+    record->kind = (uint8_t)whole.codec;
+    record->length = (uint16_t)whole.length;
+    memcpy(record->payload, whole.bytes, whole.length);
+  }
+}
+
+typedef struct {
+  const WorldSnapshot *snapshot;
+  DeltaRecord *records;
+  atomic_size_t *progress;
+} DeltaEncodeJob;
+
+static void delta_encode_task(void *context, size_t i) {
+  DeltaEncodeJob *job = context;
+  const WorldSnapshot *snapshot = job->snapshot;
+  const Chunk *chunk = &snapshot->chunks[i];
+  Chunk decoded = {0};
+  if (snapshot->entries && snapshot->entries[i] != CHUNK_NO_ENTRY) {
+    WorldFileEntry entry;
+    world_format_mapped_entry(snapshot->mapping, snapshot->entries[i], &entry);
+    world_format_decode_chunk(snapshot->mapping->data, &entry, &decoded);
+    chunk = &decoded;
+  }
+  delta_diff_chunk(chunk, snapshot->chunks[i].coord, snapshot->seed, snapshot->generator,
+                   &job->records[i]);
+  chunk_free(&decoded);
+  if (job->progress) {
+    atomic_fetch_add_explicit(job->progress, 1, memory_order_relaxed);
+  }
+}
+
+// Encodes `snapshot` as a delta file into `out`, comparing chunks with
+// generation on the worker pool. `progress`, if not NULL, counts the chunks
+// compared so far.
+void delta_encode(const WorldSnapshot *snapshot, ByteBuffer *out, atomic_size_t *progress) {
+  DeltaRecord *records = malloc((snapshot->count ? snapshot->count : 1) * sizeof(DeltaRecord));
+  DeltaEncodeJob job = {.snapshot = snapshot, .records = records, .progress = progress};
+  pool_for(snapshot->count, delta_encode_task, &job);
+
+  uint8_t *header = byte_buffer_extend(out, DELTA_HEADER_SIZE);
+  memcpy(header, DELTA_MAGIC, 4);
+  put_u16(header + 4, DELTA_VERSION);
+  header[6] = GRID_X;
+  header[7] = GRID_Y;
+  put_u32(header + 8, snapshot->generator);
+  put_u64(header + 12, snapshot->seed);
+  put_f32(header + 20, snapshot->camera.offset.x);
+  put_f32(header + 24, snapshot->camera.offset.y);
+  put_f32(header + 28, snapshot->camera.target.x);
+  put_f32(header + 32, snapshot->camera.target.y);
+
+  uint32_t count = 0;
+  for (size_t i = 0; i < snapshot->count; ++i) {
+    const DeltaRecord *record = &records[i];
+    if (!record->changed) {
+      continue;
+    }
+    ChunkCoord coord = snapshot->chunks[i].coord;
+    uint8_t *p = byte_buffer_extend(out, DELTA_RECORD_SIZE + record->length);
+    put_u32(p, (uint32_t)coord.x);
+    put_u32(p + 4, (uint32_t)coord.y);
+    p[8] = record->kind;
+    put_u16(p + 9, record->length);
+    memcpy(p + DELTA_RECORD_SIZE, record->payload, record->length);
+    count++;
+  }
+  put_u32(out->data + 36, count);
+  free(records);
+}
+
+typedef struct {
+  const uint8_t *data;
+  uint64_t seed;
+  uint32_t generator;
+  const WorldFileEntry *entries; // `codec` holds the record kind.
+  Chunk **chunks;
+  atomic_bool corrupt;
+} DeltaDecodeJob;
+
+static void delta_decode_task(void *context, size_t i) {
+  DeltaDecodeJob *job = context;
+  const WorldFileEntry *entry = &job->entries[i];
+  Chunk *chunk = job->chunks[i];
+  bool ok = true;
+  if (entry->codec == DELTA_CHUNK_EDITS) {
+    chunk_generate(chunk, job->seed, job->generator, entry->coord.x, entry->coord.y);
+    const uint8_t *edits = job->data + entry->offset;
+    for (uint32_t e = 0; e + 1 < entry->length && ok; e += 2) {
+      ok = edits[e] < CHUNK_CELLS;
+      if (ok) {
+        chunk_set(chunk, edits[e] % GRID_X, edits[e] / GRID_X, (BlockType)edits[e + 1]);
+      }
+    }
+    chunk_compact(chunk);
+  } else {
+    ok = world_format_decode_chunk(job->data, entry, chunk);
+  }
+  if (!ok) {
+    printf("chunk (%d, %d) is corrupt\n", entry->coord.x, entry->coord.y);
+    atomic_store_explicit(&job->corrupt, true, memory_order_relaxed);
+  }
+}
+
+// Replaces the contents of `world` with the delta file in `data`: every
+// stored chunk is generated and its edits applied, on the worker pool, and
+// the world takes over the file's seed and generator. Returns false if the
+// file is corrupt or was made by a generator this build does not have.
+bool delta_decode(Camera2D *camera, World *world, const uint8_t *data, size_t size) {
+  if (size < DELTA_HEADER_SIZE || !delta_format_is_delta(data, size)) {
+    printf("not a delta world file\n");
+    return false;
+  }
+  if (get_u16(data + 4) != DELTA_VERSION) {
+    printf("unsupported delta format version %d\n", get_u16(data + 4));
+    return false;
+  }
+  if (data[6] != GRID_X || data[7] != GRID_Y) {
+    printf("world was saved with %dx%d chunks, this build uses %dx%d\n", data[6], data[7], GRID_X, GRID_Y);
+    return false;
+  }
+  uint32_t generator = get_u32(data + 8);
+  if (!generator_is_known(generator)) {
+    printf("world was generated by generator %u, this build has %d to %d\n", generator, GENERATOR_MIN_VERSION,
+           GENERATOR_VERSION);
+    return false;
+  }
+  camera->offset = (Vector2){get_f32(data + 20), get_f32(data + 24)};
+  camera->target = (Vector2){get_f32(data + 28), get_f32(data + 32)};
+  world_clear(world);
+  world->seed = get_u64(data + 12);
+  world->generator = generator;
+
+  // Records are read and their chunks created first; a chunk stored twice
+  // keeps its last record.
+  uint32_t count = get_u32(data + 36);
+  if (count > (size - DELTA_HEADER_SIZE) / DELTA_RECORD_SIZE) {
+    printf("delta world file is truncated\n");
+    return false;
+  }
+  WorldFileEntry *entries = malloc((count ? count : 1) * sizeof(WorldFileEntry));
+  size_t offset = DELTA_HEADER_SIZE;
+  for (uint32_t i = 0; i < count; ++i) {
+    const uint8_t *p = data + offset;
+    if (offset + DELTA_RECORD_SIZE > size || offset + DELTA_RECORD_SIZE + get_u16(p + 9) > size) {
+      printf("delta chunk %u lies outside the world file\n", i);
+      free(entries);
+      return false;
+    }
+    ChunkCoord coord = {(int32_t)get_u32(p), (int32_t)get_u32(p + 4)};
+    entries[i] = (WorldFileEntry){
+        .coord = coord,
+        .bounds = world_chunk_bounds(coord.x, coord.y),
+        .offset = offset + DELTA_RECORD_SIZE,
+        .length = get_u16(p + 9),
+        .codec = p[8],
+    };
+    offset = entries[i].offset + entries[i].length;
+  }
+  Chunk **chunks = malloc((count ? count : 1) * sizeof(Chunk *));
+  size_t first = count;
+  world_reserve(world, count);
+  for (size_t i = count; i-- > 0;) {
+    bool created = false;
+    Chunk *chunk = world_insert_chunk(world, entries[i].coord.x, entries[i].coord.y, &created);
+    if (created) {
+      entries[--first] = entries[i];
+      chunks[first] = chunk;
+    }
+  }
+  DeltaDecodeJob job = {
+      .data = data,
+      .seed = world->seed,
+      .generator = world->generator,
+      .entries = entries + first,
+      .chunks = chunks + first,
+  };
+  atomic_init(&job.corrupt, false);
+  pool_for(count - first, delta_decode_task, &job);
+  world_account_chunks(world, chunks + first, count - first);
+  free(chunks);
+  free(entries);
+  if (atomic_load(&job.corrupt)) {
+    return false;
+  }
+  world_clear_save_dirty(world);
+  return true;
+}
+
+#endif
@@ -0,0 +1,608 @@
+#ifndef FORMAT_H
+#define FORMAT_H
+
+#include "chunk.h"
+#include "deflate.h"
+#include "game.h"
+#include "mapping.h"
+#include "pool.h"
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Binary world format. All integers are little-endian, floats are IEEE-754
+// singles stored like a u32.
+//
+//   header     WORLD_HEADER_SIZE bytes
+//     char magic[4]      "BBWD"
+//     u16  version       WORLD_FORMAT_VERSION
+//     u8   grid_x, grid_y
+//     u32  chunk_count
+//     f32  camera offset x, y, camera target x, y
+//     u32  generator     generator version the chunks were generated with
+//     u64  seed
+//     u32  reserved      zero
+//   directory  chunk_count entries of WORLD_ENTRY_SIZE bytes
+//     i32  cx, cy
+//     f32  bounds x, y, width, height
+//     u64  payload offset, from the start of the file
+//     u32  payload length
+//     u32  codec         ChunkCodec
+//   payloads   one per chunk
+//   journal    zero or more segments, appended by later saves
+//     char magic[4]      "BBJS"
+//     u32  size          of the whole segment
+//     u32  chunk_count
+//     f32  camera offset x, y, camera target x, y
+//     chunk_count records of WORLD_RECORD_SIZE bytes, each followed by its
+//     payload
+//       i32  cx, cy
+//       f32  bounds x, y, width, height
+//       u32  payload length
+//       u32  codec
+//     u32  checksum      FNV-1a of the segment up to here
+//
+// Segments apply in order over the base image (header, directory and
+// payloads), each replacing the chunks it holds and the camera. A segment
+// torn by a crash fails its size or checksum and is ignored along with
+// anything after it.
+//
+// A CHUNK_CODEC_RAW payload is CHUNK_CELLS block ids, row-major, with air
+// stored as 0xFF. A CHUNK_CODEC_RLE payload is a sequence of row groups, each
+// starting with a byte n: for n < 0x80, n identical uniform rows follow as a
+// single block id; otherwise (n & 0x7F) rows follow verbatim. A
+// CHUNK_CODEC_DEFLATE payload is the raw payload as a raw DEFLATE stream
+// (deflate.h). Version 2 files only have raw payloads, version 3 files have
+// no journal, and files before version 5 have a WORLD_HEADER_V4_SIZE byte
+// header without the generator and seed.
+#define WORLD_MAGIC "BBWD"
+#define WORLD_JOURNAL_MAGIC "BBJS"
+#define WORLD_FORMAT_VERSION 5
+#define WORLD_FORMAT_MIN_VERSION 2
+#define WORLD_HEADER_SIZE 48
+#define WORLD_HEADER_V4_SIZE 32
+#define WORLD_ENTRY_SIZE 40
+#define WORLD_SEGMENT_HEADER_SIZE 28
+#define WORLD_RECORD_SIZE 32
+
+typedef enum {
+  CHUNK_CODEC_RAW,
+  CHUNK_CODEC_RLE,
+  CHUNK_CODEC_DEFLATE,
+  CHUNK_CODEC_COUNT,
+} ChunkCodec;
+
+// Sets of codecs the encoder may pick from; it keeps the smallest payload.
+#define CHUNK_CODEC_BIT(codec) (1u << (codec))
+#define WORLD_CODECS_ALL (CHUNK_CODEC_BIT(CHUNK_CODEC_COUNT) - 1)
+
+static const char *CHUNK_CODEC_NAMES[CHUNK_CODEC_COUNT] = {"raw", "rle", "deflate"};
+
+typedef struct {
+  uint16_t version;
+  uint32_t chunk_count;
+  Vector2 camera_offset;
+  Vector2 camera_target;
+  uint32_t generator; // 0 in files from before version 5.
+  uint64_t seed;
+} WorldFileHeader;
+
+typedef struct {
+  ChunkCoord coord;
+  Rectangle bounds;
+  uint64_t offset;
+  uint32_t length;
+  uint32_t codec;
+} WorldFileEntry;
+
+typedef struct {
+  uint32_t chunk_count;
+  Vector2 camera_offset;
+  Vector2 camera_target;
+  size_t records;     // File offset of the first record.
+  size_t records_end; // File offset of the checksum.
+  size_t end;         // File offset just past the segment.
+} WorldJournalSegment;
+
+typedef struct {
+  uint8_t *data;
+  size_t size;
+  size_t capacity;
+} ByteBuffer;
+
+static inline void byte_buffer_reserve(ByteBuffer *buffer, size_t size) {
+  if (buffer->size + size > buffer->capacity) {
+    size_t capacity = buffer->capacity ? buffer->capacity : 4096;
+    while (capacity < buffer->size + size) {
+      capacity *= 2;
+    }
+    buffer->data = realloc(buffer->data, capacity);
+    buffer->capacity = capacity;
+  }
+}
+
+// Grows the buffer by `size` bytes and returns where they start.
+static inline uint8_t *byte_buffer_extend(ByteBuffer *buffer, size_t size) {
+  byte_buffer_reserve(buffer, size);
+  uint8_t *start = buffer->data + buffer->size;
+  buffer->size += size;
+  return start;
+}
+
+static inline void byte_buffer_free(ByteBuffer *buffer) {
+  free(buffer->data);
+  *buffer = (ByteBuffer){0};
+}
+
+static inline void put_u16(uint8_t *p, uint16_t v) {
+  p[0] = v;
+  p[1] = v >> 8;
+}
+
+static inline void put_u32(uint8_t *p, uint32_t v) {
+  p[0] = v;
+  p[1] = v >> 8;
+  p[2] = v >> 16;
+  p[3] = v >> 24;
+}
+
+static inline void put_u64(uint8_t *p, uint64_t v) {
+  put_u32(p, (uint32_t)v);
+  put_u32(p + 4, (uint32_t)(v >> 32));
+}
+
+static inline void put_f32(uint8_t *p, float v) {
+  uint32_t bits;
+  memcpy(&bits, &v, sizeof(bits));
+  put_u32(p, bits);
+}
+
+static inline uint16_t get_u16(const uint8_t *p) { return (uint16_t)(p[0] | p[1] << 8); }
+
+static inline uint32_t get_u32(const uint8_t *p) {
+  return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static inline uint64_t get_u64(const uint8_t *p) { return get_u32(p) | (uint64_t)get_u32(p + 4) << 32; }
+
+static inline float get_f32(const uint8_t *p) {
+  uint32_t bits = get_u32(p);
+  float v;
+  memcpy(&v, &bits, sizeof(v));
+  return v;
+}
+
+static inline bool world_format_is_binary(const uint8_t *data, size_t size) {
+  return size >= 4 && memcmp(data, WORLD_MAGIC, 4) == 0;
+}
+
+// Where the directory starts in a file of format `version`.
+static inline size_t world_format_header_size(uint16_t version) {
+  return version >= 5 ? WORLD_HEADER_SIZE : WORLD_HEADER_V4_SIZE;
+}
+
+static void world_format_put_header(uint8_t *p, const WorldFileHeader *header) {
+  memset(p, 0, WORLD_HEADER_SIZE);
+  memcpy(p, WORLD_MAGIC, 4);
+  put_u16(p + 4, header->version);
+  p[6] = GRID_X;
+  p[7] = GRID_Y;
+  put_u32(p + 8, header->chunk_count);
+  put_f32(p + 12, header->camera_offset.x);
+  put_f32(p + 16, header->camera_offset.y);
+  put_f32(p + 20, header->camera_target.x);
+  put_f32(p + 24, header->camera_target.y);
+  put_u32(p + 28, header->generator);
+  put_u64(p + 32, header->seed);
+}
+
+static void world_format_put_entry(uint8_t *p, const WorldFileEntry *entry) {
+  put_u32(p, (uint32_t)entry->coord.x);
+  put_u32(p + 4, (uint32_t)entry->coord.y);
+  put_f32(p + 8, entry->bounds.x);
+  put_f32(p + 12, entry->bounds.y);
+  put_f32(p + 16, entry->bounds.width);
+  put_f32(p + 20, entry->bounds.height);
+  put_u64(p + 24, entry->offset);
+  put_u32(p + 32, entry->length);
+  put_u32(p + 36, entry->codec);
+}
+
+// Validates the header and that the directory fits in the file. Prints why
+// and returns false if the file cannot be read by this build.
+bool world_format_parse_header(const uint8_t *data, size_t size, WorldFileHeader *header) {
+  if (size < WORLD_HEADER_V4_SIZE || !world_format_is_binary(data, size)) {
+    printf("not a binary world file\n");
+    return false;
+  }
+  header->version = get_u16(data + 4);
+  if (header->version < WORLD_FORMAT_MIN_VERSION || header->version > WORLD_FORMAT_VERSION) {
+    printf("unsupported world format version %d\n", header->version);
+    return false;
+  }
+  size_t header_size = world_format_header_size(header->version);
+  if (size < header_size) {
+    printf("world file is truncated\n");
+    return false;
+  }
+  if (data[6] != GRID_X || data[7] != GRID_Y) {
+    printf("world was saved with %dx%d chunks, this build uses %dx%d\n", data[6], data[7], GRID_X, GRID_Y);
+    return false;
+  }
+  header->chunk_count = get_u32(data + 8);
+  header->camera_offset = (Vector2){get_f32(data + 12), get_f32(data + 16)};
+  header->camera_target = (Vector2){get_f32(data + 20), get_f32(data + 24)};
+  header->generator = header->version >= 5 ? get_u32(data + 28) : 0;
+  header->seed = header->version >= 5 ? get_u64(data + 32) : 0;
+  if ((size - header_size) / WORLD_ENTRY_SIZE < header->chunk_count) {
+    printf("world file is truncated\n");
+    return false;
+  }
+  return true;
+}
+
+// Reads directory entry `index` of a file whose header has been parsed;
+// false if its payload lies outside the file.
+bool world_format_parse_entry(const uint8_t *data, size_t size, uint32_t index, WorldFileEntry *entry) {
+  const uint8_t *p = data + world_format_header_size(get_u16(data + 4)) + (size_t)index * WORLD_ENTRY_SIZE;
+  entry->coord = (ChunkCoord){(int32_t)get_u32(p), (int32_t)get_u32(p + 4)};
+  entry->bounds = (Rectangle){get_f32(p + 8), get_f32(p + 12), get_f32(p + 16), get_f32(p + 20)};
+  entry->offset = get_u64(p + 24);
+  entry->length = get_u32(p + 32);
+  entry->codec = get_u32(p + 36);
+  return entry->offset <= size && entry->length <= size - entry->offset;
+}
+
+// Where the payload of a directory entry ends. The base image ends with the
+// furthest one, and the journal starts there.
+static inline size_t world_format_entry_end(const WorldFileEntry *entry) {
+  return (size_t)(entry->offset + entry->length);
+}
+
+static uint32_t world_format_checksum(const uint8_t *data, size_t size) {
+  uint32_t hash = 0x811c9dc5u;
+  for (size_t i = 0; i < size; ++i) {
+    hash = (hash ^ data[i]) * 0x01000193u;
+  }
+  return hash;
+}
+
+// Validates the journal segment at `offset`. False at the end of the file
+// and on a torn or corrupt segment.
+bool world_format_parse_segment(const uint8_t *data, size_t size, size_t offset, WorldJournalSegment *segment) {
+  if (offset > size || size - offset < WORLD_SEGMENT_HEADER_SIZE + 4 ||
+      memcmp(data + offset, WORLD_JOURNAL_MAGIC, 4) != 0) {
+    return false;
+  }
+  const uint8_t *p = data + offset;
+  uint32_t length = get_u32(p + 4);
+  if (length < WORLD_SEGMENT_HEADER_SIZE + 4 || length > size - offset ||
+      world_format_checksum(p, length - 4) != get_u32(p + length - 4)) {
+    return false;
+  }
+  segment->chunk_count = get_u32(p + 8);
+  segment->camera_offset = (Vector2){get_f32(p + 12), get_f32(p + 16)};
+  segment->camera_target = (Vector2){get_f32(p + 20), get_f32(p + 24)};
+  segment->records = offset + WORLD_SEGMENT_HEADER_SIZE;
+  segment->records_end = offset + length - 4;
+  segment->end = offset + length;
+  return true;
+}
+
+// Reads the journal record at `*offset` and moves `*offset` past its
+// payload. False if the record or its payload extends beyond `end`.
+bool world_format_parse_record(const uint8_t *data, size_t end, size_t *offset, WorldFileEntry *entry) {
+  if (*offset > end || end - *offset < WORLD_RECORD_SIZE) {
+    return false;
+  }
+  const uint8_t *p = data + *offset;
+  entry->coord = (ChunkCoord){(int32_t)get_u32(p), (int32_t)get_u32(p + 4)};
+  entry->bounds = (Rectangle){get_f32(p + 8), get_f32(p + 12), get_f32(p + 16), get_f32(p + 20)};
+  entry->length = get_u32(p + 24);
+  entry->codec = get_u32(p + 28);
+  entry->offset = *offset + WORLD_RECORD_SIZE;
+  if (entry->length > end - entry->offset) {
+    return false;
+  }
+  *offset = entry->offset + entry->length;
+  return true;
+}
+
+// Entry `index` of a mapped world: its directory entries first, then its
+// journal records in file order. Both were validated when it was mapped.
+static inline void world_format_mapped_entry(const WorldMapping *mapping, uint32_t index, WorldFileEntry *entry) {
+  if (index < mapping->chunk_count) {
+    world_format_parse_entry(mapping->data, mapping->size, index, entry);
+  } else {
+    size_t offset = mapping->records[index - mapping->chunk_count];
+    world_format_parse_record(mapping->data, mapping->size, &offset, entry);
+  }
+}
+
+// Longest possible RLE payload: every row its own verbatim group.
+#define CHUNK_RLE_MAX_SIZE (GRID_Y * (1 + GRID_X))
+// RLE payloads up to this size are kept without trying DEFLATE, which only
+// pays off on chunks with little row structure.
+#define CHUNK_DEFLATE_MIN_RLE (CHUNK_CELLS / 4)
+static_assert(CHUNK_CELLS <= DEFLATE_MAX_INPUT, "chunks must fit the DEFLATE encoder");
+
+static inline bool chunk_row_is(const BlockId *row, BlockId id) {
+  for (int x = 0; x < GRID_X; ++x) {
+    if (row[x] != id) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Writes the RLE payload of `cells` to `out`, returning its length.
+static size_t chunk_rle_encode(const BlockId cells[CHUNK_CELLS], uint8_t out[CHUNK_RLE_MAX_SIZE]) {
+  size_t n = 0;
+  for (int y = 0; y < GRID_Y;) {
+    const BlockId *row = cells + y * GRID_X;
+    int count = 1;
+    if (chunk_row_is(row, row[0])) {
+      while (y + count < GRID_Y && chunk_row_is(row + count * GRID_X, row[0])) {
+        count++;
+      }
+      out[n++] = count;
+      out[n++] = row[0];
+    } else {
+      while (y + count < GRID_Y && !chunk_row_is(row + count * GRID_X, row[count * GRID_X])) {
+        count++;
+      }
+      out[n++] = 0x80 | count;
+      memcpy(out + n, row, count * GRID_X);
+      n += count * GRID_X;
+    }
+    y += count;
+  }
+  return n;
+}
+
+static bool chunk_rle_decode(const uint8_t *payload, size_t length, BlockId cells[CHUNK_CELLS]) {
+  size_t n = 0;
+  int y = 0;
+  while (n < length && y < GRID_Y) {
+    int count = payload[n] & 0x7F;
+    bool verbatim = payload[n++] & 0x80;
+    if (count == 0 || y + count > GRID_Y) {
+      return false;
+    }
+    size_t size = verbatim ? (size_t)count * GRID_X : 1;
+    if (length - n < size) {
+      return false;
+    }
+    if (verbatim) {
+      memcpy(cells + y * GRID_X, payload + n, size);
+    } else {
+      memset(cells + y * GRID_X, payload[n], (size_t)count * GRID_X);
+    }
+    n += size;
+    y += count;
+  }
+  return y == GRID_Y && n == length;
+}
+
+// A chunk's payload, encoded on its own so that chunks can be encoded in
+// parallel and laid out in the file afterwards. No payload is larger than
+// the raw one, which is always allowed.
+typedef struct {
+  const uint8_t *bytes; // `data`, or the payload in the snapshot's mapping.
+  uint32_t length;
+  ChunkCodec codec;
+  uint8_t data[CHUNK_CELLS];
+} ChunkPayload;
+
+// Encodes `chunk` into `out` in whichever of `codecs` gives the smallest
+// payload. Raw is always allowed.
+void chunk_payload_encode(const Chunk *chunk, uint32_t codecs, ChunkPayload *out) {
+  BlockId cells[CHUNK_CELLS];
+  chunk_store_cells(chunk, cells);
+  ChunkCodec best = CHUNK_CODEC_RAW;
+  const uint8_t *payload = cells;
+  size_t length = CHUNK_CELLS;
+
+  uint8_t rle[CHUNK_RLE_MAX_SIZE];
+  if (codecs & CHUNK_CODEC_BIT(CHUNK_CODEC_RLE)) {
+    size_t size = chunk_rle_encode(cells, rle);
+    if (size < length) {
+      best = CHUNK_CODEC_RLE;
+      payload = rle;
+      length = size;
+    }
+  }
+  uint8_t deflated[CHUNK_CELLS];
+  if ((codecs & CHUNK_CODEC_BIT(CHUNK_CODEC_DEFLATE)) && !(best == CHUNK_CODEC_RLE && length <= CHUNK_DEFLATE_MIN_RLE)) {
+    size_t size = deflate_encode(cells, CHUNK_CELLS, deflated, length - 1);
+    if (size) {
+      best = CHUNK_CODEC_DEFLATE;
+      payload = deflated;
+      length = size;
+    }
+  }
+  memcpy(out->data, payload, length);
+  out->bytes = out->data;
+  out->length = (uint32_t)length;
+  out->codec = best;
+}
+
+// Appends the payload of `chunk` to `out` in whichever of `codecs` gives the
+// smallest one, returning the codec used.
+ChunkCodec world_format_encode_chunk(const Chunk *chunk, uint32_t codecs, ByteBuffer *out) {
+  ChunkPayload payload;
+  chunk_payload_encode(chunk, codecs, &payload);
+  memcpy(byte_buffer_extend(out, payload.length), payload.bytes, payload.length);
+  return payload.codec;
+}
+
+// Decodes the payload described by `entry` into `chunk` (zeroed or
+// initialized). Returns false on a corrupt payload or unknown codec.
+bool world_format_decode_chunk(const uint8_t *data, const WorldFileEntry *entry, Chunk *chunk) {
+  const uint8_t *payload = data + entry->offset;
+  BlockId cells[CHUNK_CELLS];
+  switch (entry->codec) {
+  case CHUNK_CODEC_RAW:
+    if (entry->length != CHUNK_CELLS) {
+      return false;
+    }
+    memcpy(cells, payload, CHUNK_CELLS);
+    break;
+  case CHUNK_CODEC_RLE:
+    if (!chunk_rle_decode(payload, entry->length, cells)) {
+      return false;
+    }
+    break;
+  case CHUNK_CODEC_DEFLATE:
+    if (!deflate_decode(payload, entry->length, cells, CHUNK_CELLS)) {
+      return false;
+    }
+    break;
+  default:
+    return false;
+  }
+  chunk->bounds = entry->bounds;
+  chunk_load_cells(chunk, cells);
+  return true;
+}
+
+typedef struct {
+  const uint8_t *data;
+  const WorldFileEntry *entries;
+  Chunk **chunks;
+  atomic_bool corrupt;
+} WorldDecodeJob;
+
+static void world_format_decode_task(void *context, size_t i) {
+  WorldDecodeJob *job = context;
+  if (!world_format_decode_chunk(job->data, &job->entries[i], job->chunks[i])) {
+    printf("chunk (%d, %d) is corrupt\n", job->entries[i].coord.x, job->entries[i].coord.y);
+    atomic_store_explicit(&job->corrupt, true, memory_order_relaxed);
+  }
+}
+
+// Decodes the payloads of `entries` in `data` into `chunks` on the worker
+// pool. The chunks must be distinct. Returns false if any payload is
+// corrupt.
+bool world_format_decode_chunks(const uint8_t *data, const WorldFileEntry *entries, Chunk **chunks, size_t count) {
+  WorldDecodeJob job = {.data = data, .entries = entries, .chunks = chunks};
+  atomic_init(&job.corrupt, false);
+  pool_for(count, world_format_decode_task, &job);
+  return !atomic_load(&job.corrupt);
+}
+
+typedef struct {
+  const WorldSnapshot *snapshot;
+  uint32_t codecs;
+  ChunkPayload *payloads;
+  atomic_size_t *progress;
+} WorldPayloadJob;
+
+// Encodes chunk `i` of the snapshot and counts it in `progress` (may be
+// NULL). Chunks still undecoded in the snapshot's mapping keep the payload
+// they have there.
+static void world_format_payload_task(void *context, size_t i) {
+  WorldPayloadJob *job = context;
+  const WorldSnapshot *snapshot = job->snapshot;
+  ChunkPayload *payload = &job->payloads[i];
+  if (snapshot->entries && snapshot->entries[i] != CHUNK_NO_ENTRY) {
+    WorldFileEntry source;
+    world_format_mapped_entry(snapshot->mapping, snapshot->entries[i], &source);
+    payload->bytes = snapshot->mapping->data + source.offset;
+    payload->length = source.length;
+    payload->codec = source.codec;
+  } else {
+    chunk_payload_encode(&snapshot->chunks[i], job->codecs, payload);
+  }
+  if (job->progress) {
+    atomic_fetch_add_explicit(job->progress, 1, memory_order_relaxed);
+  }
+}
+
+// Encodes every chunk of `snapshot` on the worker pool, returning their
+// payloads in snapshot order (free with free()). `size`, if not NULL, is
+// set to their total length.
+ChunkPayload *world_format_encode_payloads(const WorldSnapshot *snapshot, uint32_t codecs, atomic_size_t *progress,
+                                           size_t *size) {
+  ChunkPayload *payloads = malloc((snapshot->count ? snapshot->count : 1) * sizeof(ChunkPayload));
+  WorldPayloadJob job = {.snapshot = snapshot, .codecs = codecs, .payloads = payloads, .progress = progress};
+  pool_for(snapshot->count, world_format_payload_task, &job);
+  if (size) {
+    *size = 0;
+    for (size_t i = 0; i < snapshot->count; ++i) {
+      *size += payloads[i].length;
+    }
+  }
+  return payloads;
+}
+
+// Encodes a whole snapshot into `out`: header, directory, then payloads,
+// each chunk in the smallest of `codecs`. Chunks are encoded on the worker
+// pool and then laid out in order. `progress`, if not NULL, counts the
+// chunks encoded so far.
+void world_format_encode(const WorldSnapshot *snapshot, uint32_t codecs, ByteBuffer *out, atomic_size_t *progress) {
+  WorldFileHeader header = {
+      .version = WORLD_FORMAT_VERSION,
+      .chunk_count = (uint32_t)snapshot->count,
+      .camera_offset = snapshot->camera.offset,
+      .camera_target = snapshot->camera.target,
+      .generator = snapshot->generator,
+      .seed = snapshot->seed,
+  };
+  size_t size;
+  ChunkPayload *payloads = world_format_encode_payloads(snapshot, codecs, progress, &size);
+  size_t directory = out->size + WORLD_HEADER_SIZE;
+  byte_buffer_reserve(out, WORLD_HEADER_SIZE + snapshot->count * WORLD_ENTRY_SIZE + size);
+  world_format_put_header(byte_buffer_extend(out, WORLD_HEADER_SIZE + snapshot->count * WORLD_ENTRY_SIZE), &header);
+  for (size_t i = 0; i < snapshot->count; ++i) {
+    const Chunk *chunk = &snapshot->chunks[i];
+    WorldFileEntry entry = {
+        .coord = chunk->coord,
+        .bounds = chunk->bounds,
+        .offset = out->size,
+        .length = payloads[i].length,
+        .codec = payloads[i].codec,
+    };
+    memcpy(byte_buffer_extend(out, entry.length), payloads[i].bytes, entry.length);
+    world_format_put_entry(out->data + directory + i * WORLD_ENTRY_SIZE, &entry);
+  }
+  free(payloads);
+}
+
+// Encodes `snapshot` as one journal segment appended to `out`.
+void world_format_encode_segment(const WorldSnapshot *snapshot, uint32_t codecs, ByteBuffer *out,
+                                 atomic_size_t *progress) {
+  size_t size;
+  ChunkPayload *payloads = world_format_encode_payloads(snapshot, codecs, progress, &size);
+  byte_buffer_reserve(out, WORLD_SEGMENT_HEADER_SIZE + snapshot->count * WORLD_RECORD_SIZE + size + 4);
+  size_t start = out->size;
+  uint8_t *p = byte_buffer_extend(out, WORLD_SEGMENT_HEADER_SIZE);
+  memcpy(p, WORLD_JOURNAL_MAGIC, 4);
+  put_u32(p + 8, (uint32_t)snapshot->count);
+  put_f32(p + 12, snapshot->camera.offset.x);
+  put_f32(p + 16, snapshot->camera.offset.y);
+  put_f32(p + 20, snapshot->camera.target.x);
+  put_f32(p + 24, snapshot->camera.target.y);
+  for (size_t i = 0; i < snapshot->count; ++i) {
+    const Chunk *chunk = &snapshot->chunks[i];
+    p = byte_buffer_extend(out, WORLD_RECORD_SIZE + payloads[i].length);
+    put_u32(p, (uint32_t)chunk->coord.x);
+    put_u32(p + 4, (uint32_t)chunk->coord.y);
+    put_f32(p + 8, chunk->bounds.x);
+    put_f32(p + 12, chunk->bounds.y);
+    put_f32(p + 16, chunk->bounds.width);
+    put_f32(p + 20, chunk->bounds.height);
+    put_u32(p + 24, payloads[i].length);
+    put_u32(p + 28, payloads[i].codec);
+    memcpy(p + WORLD_RECORD_SIZE, payloads[i].bytes, payloads[i].length);
+  }
+  put_u32(out->data + start + 4, (uint32_t)(out->size + 4 - start));
+  uint32_t checksum = world_format_checksum(out->data + start, out->size - start);
+  put_u32(byte_buffer_extend(out, 4), checksum);
+  free(payloads);
+}
+
+#endif
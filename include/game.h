@@ -2,8 +2,10 @@
 #define GAME_H
 
 #include "raylib.h"
+#include <assert.h>
 #include <dirent.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -22,12 +24,176 @@ typedef enum {
 #define GRID_Y 12
 #define BLOCK_SIZE_X (int)(SCREEN_WIDTH / GRID_X)
 #define BLOCK_SIZE_Y (int)(SCREEN_HEIGHT / GRID_Y)
-#define N_CHUNKS ((int)24)
+#define CHUNK_WIDTH (BLOCK_SIZE_X * GRID_X)
+#define CHUNK_HEIGHT (BLOCK_SIZE_Y * GRID_Y)
+// Chunks either side of / above and below the player that are generated if
+// missing.
+#define WORLD_LOAD_RADIUS 3
+#define WORLD_LOAD_RADIUS_Y 2
 
+#define CHUNK_CELLS (GRID_X * GRID_Y)
+#define CHUNK_ALL_ROWS ((uint16_t)((1u << GRID_Y) - 1))
+static_assert(GRID_Y <= 16, "chunk dirty rows are tracked in a uint16_t");
+
+// Bumped whenever terrain generation (generate.h) changes its output.
+// Worlds record the version their chunks were generated with, and every
+// version from GENERATOR_MIN_VERSION on can still be generated.
+#define GENERATOR_VERSION 3
+#define GENERATOR_MIN_VERSION 1
+
+// Memory chunks may use before the least recently used ones far from the
+// player are swapped out to disk (see world_trim).
+#define WORLD_MEMORY_BUDGET (4 * 1024 * 1024)
+
+// Block ids are one byte; BLOCK_TYPE_AIR (-1) is stored as 0xFF.
+typedef uint8_t BlockId;
+
+// Chunk (cx, cy) covers world pixels [cx * CHUNK_WIDTH, (cx + 1) * CHUNK_WIDTH)
+// horizontally and likewise with CHUNK_HEIGHT vertically; +y is down.
+typedef struct {
+  int32_t x;
+  int32_t y;
+} ChunkCoord;
+
+// Consumers of chunk changes. Every block write marks the changed row dirty
+// for all of them; each consumer clears its own bits once it has caught up.
+typedef enum {
+  CHUNK_DIRTY_SAVE,   // Not yet written to the world file.
+  CHUNK_DIRTY_RENDER, // Chunk mesh rows to rebuild.
+  CHUNK_DIRTY_SWAP,   // Swap record (world.h) is out of date.
+  CHUNK_DIRTY_CONSUMERS,
+} ChunkDirtyConsumer;
+
+// A horizontal run of identical blocks, drawn as one tiled quad.
 typedef struct {
+  uint8_t x;
+  uint8_t length;
+  int16_t texture;
+} BlockRun;
+
+// Render cache of a chunk: the runs of drawable blocks in each row.
+typedef struct {
+  uint8_t n_runs[GRID_Y];
+  BlockRun runs[GRID_Y][GRID_X];
+} ChunkMesh;
+
+// Blocks are palette-compressed: `data` holds the palette (1 << bits
+// entries) followed by CHUNK_CELLS indices packed `bits` (1, 2, 4 or 8) at a
+// time. A chunk made of a single block type has bits == 0, no `data`, and
+// stores that type in `uniform`. Always go through chunk_get / chunk_set in
+// chunk.h.
+typedef struct Chunk Chunk;
+struct Chunk {
   Rectangle bounds;
-  BlockType blocks[BLOCK_SIZE_Y][BLOCK_SIZE_X];
-} Chunk;
+  uint8_t bits;
+  BlockId uniform;
+  uint16_t palette_size;
+  uint8_t *data;
+
+  // Row of the topmost solid block in each column, GRID_Y if there is none.
+  uint8_t heightmap[GRID_X];
+
+  // One bit per row, per ChunkDirtyConsumer.
+  uint16_t dirty_rows[CHUNK_DIRTY_CONSUMERS];
+  ChunkMesh *mesh;
+
+  // Residency bookkeeping, owned by world.h.
+  ChunkCoord coord;
+  Chunk *lru_prev;
+  Chunk *lru_next;
+  size_t accounted; // Bytes counted for it in ChunkCache.resident_bytes.
+};
+
+typedef enum {
+  CHUNK_SLOT_EMPTY,
+  CHUNK_SLOT_RESIDENT,
+  CHUNK_SLOT_SWAPPED,
+  CHUNK_SLOT_MAPPED,
+} ChunkSlotState;
+
+// No directory entry in the mapped world file (see mapping.h).
+#define CHUNK_NO_ENTRY UINT32_MAX
+
+typedef struct WorldMapping WorldMapping;
+
+// Open-addressing (linear probing) map from chunk coordinate to chunk.
+// `capacity` is a power of two. A swapped-out chunk keeps its slot, with
+// `chunk` NULL and its blocks at `swap_offset` in the swap file. A mapped
+// chunk has not been decoded from the world file yet; `entry` is its
+// directory entry there, kept once it is decoded so that it can be dropped
+// again for free as long as it is unchanged.
+typedef struct {
+  ChunkCoord key;
+  uint8_t state;
+  bool save_dirty; // A swapped-out chunk still has unsaved changes.
+  uint32_t entry;
+  int64_t swap_offset;
+  Chunk *chunk;
+} ChunkSlot;
+
+// Resident chunks form an LRU list, most recently used at `lru_head`.
+typedef struct {
+  size_t budget;
+  size_t resident_bytes; // chunk_memory_usage of every resident chunk.
+  size_t hits;
+  size_t misses;
+  size_t evictions;
+  Chunk *lru_head;
+  Chunk *lru_tail;
+  FILE *swap;
+  int64_t swap_end;
+} ChunkCache;
+
+// Loading work left after a streamed load (see stream.h), nearest to
+// `center` first: mapped chunks not decoded yet, kept as a min-heap by
+// distance, and region files not read yet, sorted by distance, the first
+// of which has been read up to chunk `region_next`.
+typedef struct {
+  ChunkCoord center;
+  ChunkCoord *chunks;
+  size_t n_chunks;
+  ChunkCoord *regions;
+  size_t n_regions;
+  int region_next;
+  char *dir;
+} WorldStream;
+
+typedef struct {
+  ChunkSlot *slots;
+  size_t capacity;
+  size_t count;
+  size_t resident;
+  ChunkCache cache;
+  WorldMapping *mapping; // World file the mapped chunks come from, if any.
+  WorldStream stream;
+
+  // What missing chunks are generated with (generate.h). Kept by world_clear.
+  uint64_t seed;
+  uint32_t generator;
+
+  // Binary file the world was last loaded from or saved to, if any: where
+  // its base image ends and where the next journal segment goes (see
+  // save_should_append). Sizes are 0 while a full save is still running.
+  char *file;
+  uint64_t file_base;
+  uint64_t file_end;
+} World;
+
+// A consistent, read-only copy of the world for savers. `chunks` are
+// shallow copies (no mesh, no LRU links) sharing block data with the live
+// chunks, sorted by chunk x then y; a live chunk copies its data the first
+// time it is written while the snapshot holds it. Chunks not yet decoded
+// from `mapping` are left empty; `entries` (NULL without a mapping) gives
+// their directory entry, CHUNK_NO_ENTRY for the others.
+typedef struct {
+  Camera2D camera;
+  Chunk *chunks;
+  uint32_t *entries;
+  size_t count;
+  WorldMapping *mapping;
+  uint64_t seed;
+  uint32_t generator;
+} WorldSnapshot;
 
 typedef struct {
   Texture2D *frames;
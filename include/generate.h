@@ -0,0 +1,197 @@
+#ifndef GENERATE_H
+#define GENERATE_H
+
+#include "chunk.h"
+#include "game.h"
+#include "noise.h"
+#include "raymath.h"
+#include "world.h"
+#include <stdint.h>
+
+// Terrain generation. A chunk is a pure function of the world seed, the
+// generator version and its coordinate, so that any chunk can be generated
+// again later (see delta.h), in any order and on any thread. Changing its
+// output means bumping GENERATOR_VERSION and keeping the old version
+// around for the worlds made with it.
+
+static inline uint64_t generator_mix(uint64_t z) {
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+  return z ^ (z >> 31);
+}
+
+static inline uint64_t generator_chunk_key(uint64_t seed, int cx, int cy) {
+  uint64_t coord = (uint64_t)(uint32_t)cx << 32 | (uint32_t)cy;
+  return generator_mix(seed ^ generator_mix(coord));
+}
+
+static inline double generator_unit(uint64_t bits) { return (double)(bits >> 11) * 0x1.0p-53; }
+
+// Independent random streams of a chunk, one per thing it decides.
+typedef enum {
+  GENERATOR_STREAM_MATERIAL,
+  GENERATOR_STREAM_SURFACE,
+  GENERATOR_STREAM_LAYERS,
+} GeneratorStream;
+
+#define GENERATOR_GAMMA 0x9E3779B97F4A7C15ull
+
+// Key of stream `stream` of chunk (cx, cy).
+static inline uint64_t generator_key(uint64_t seed, int cx, int cy, GeneratorStream stream) {
+  return generator_mix(generator_chunk_key(seed, cx, cy) + (uint64_t)(stream + 1) * GENERATOR_GAMMA);
+}
+
+// Value number `counter` of the stream with `key`, uniform in [0, 1): the
+// SplitMix64 output at that position, so values can be drawn in any order.
+static inline double generator_uniform(uint64_t key, uint64_t counter) {
+  return generator_unit(generator_mix(key + (counter + 1) * GENERATOR_GAMMA));
+}
+
+// Noise fields span the whole world, so they are keyed by the seed and
+// stream alone, one key per octave.
+static NoiseField generator_noise(uint64_t seed, GeneratorStream stream, int octaves, float frequency) {
+  NoiseField field = {.octaves = octaves, .frequency = frequency};
+  uint64_t key = generator_mix(seed + (uint64_t)(stream + 1) * GENERATOR_GAMMA);
+  for (int o = 0; o < octaves; ++o) {
+    field.keys[o] = (uint32_t)generator_mix(key + (uint64_t)o * GENERATOR_GAMMA);
+  }
+  return field;
+}
+
+// Terrain of generator 3: the surface rolls around block row
+// GENERATOR_SURFACE_ROW, with grass on top and GENERATOR_TOPSOIL blocks of
+// dirt under it, then dirt and stone layers that turn to stone with depth.
+#define GENERATOR_SURFACE_ROW 6
+#define GENERATOR_SURFACE_AMPLITUDE 8.0f
+#define GENERATOR_TOPSOIL 3
+
+typedef struct {
+  NoiseField surface; // Height of each column.
+  NoiseField layers;  // Dirt or stone below the topsoil.
+} GeneratorTerrain;
+
+static GeneratorTerrain generator_terrain(uint64_t seed) {
+  return (GeneratorTerrain){
+      .surface = generator_noise(seed, GENERATOR_STREAM_SURFACE, 4, 1.0f / 64.0f),
+      .layers = generator_noise(seed, GENERATOR_STREAM_LAYERS, 3, 1.0f / 16.0f),
+  };
+}
+
+// Block row of the surface in each of the GRID_X columns from block column
+// `x`.
+static void generator_surface(const GeneratorTerrain *terrain, int x, int surface[GRID_X]) {
+  float heights[GRID_X];
+  noise_row(&terrain->surface, x, 0, GRID_X, heights);
+  for (int i = 0; i < GRID_X; ++i) {
+    surface[i] = GENERATOR_SURFACE_ROW + noise_floor(heights[i] * GENERATOR_SURFACE_AMPLITUDE);
+  }
+}
+
+static void chunk_generate_v3(Chunk *chunk, uint64_t seed, int cx, int cy) {
+  GeneratorTerrain terrain = generator_terrain(seed);
+  int surface[GRID_X];
+  generator_surface(&terrain, cx * GRID_X, surface);
+  int lowest = surface[0];
+  for (int x = 1; x < GRID_X; ++x) {
+    lowest = surface[x] < lowest ? surface[x] : lowest;
+  }
+  for (int y = 0; y < GRID_Y; ++y) {
+    int row = cy * GRID_Y + y;
+    // Rows entirely above the surface are air, as the chunk starts out.
+    if (row < lowest) {
+      continue;
+    }
+    float layers[GRID_X];
+    if (row >= lowest + GENERATOR_TOPSOIL) {
+      noise_row(&terrain.layers, cx * GRID_X, row, GRID_X, layers);
+    }
+    for (int x = 0; x < GRID_X; ++x) {
+      int depth = row - surface[x];
+      if (depth < 0) {
+        continue;
+      }
+      BlockType type = BLOCK_TYPE_DIRT;
+      if (depth == 0) {
+        type = BLOCK_TYPE_GRASS;
+      } else if (depth >= GENERATOR_TOPSOIL) {
+        float dirt = Clamp(0.4f - 0.02f * (float)depth, -0.6f, 0.4f);
+        type = layers[x] < dirt ? BLOCK_TYPE_DIRT : BLOCK_TYPE_STONE;
+      }
+      chunk_set(chunk, x, y, type);
+    }
+  }
+}
+
+// Generator 2: row 0 holds a flat surface, and everything below is a
+// dirt/stone mix that gets stonier with depth. Each cell below the topsoil
+// draws value `cell` of the material stream.
+static void chunk_generate_v2(Chunk *chunk, uint64_t seed, int cx, int cy) {
+  if (cy < 0) {
+    return;
+  }
+  const uint64_t material = generator_key(seed, cx, cy, GENERATOR_STREAM_MATERIAL);
+  const int start_depth = cy == 0 ? 6 : -GRID_Y;
+  const double stone_chance = Clamp(0.5 + 0.1 * cy, 0.5, 0.95);
+  for (int y = 0; y < GRID_Y; ++y) {
+    for (int x = 0; x < GRID_X; ++x) {
+      if (y < start_depth) {
+        chunk_set(chunk, x, y, BLOCK_TYPE_AIR);
+      } else if (y - start_depth == 0) {
+        chunk_set(chunk, x, y, BLOCK_TYPE_GRASS);
+      } else if (y - start_depth < 2) {
+        chunk_set(chunk, x, y, BLOCK_TYPE_DIRT);
+      } else {
+        double value = generator_uniform(material, (uint64_t)(y * GRID_X + x));
+        chunk_set(chunk, x, y, value < stone_chance ? BLOCK_TYPE_STONE : BLOCK_TYPE_DIRT);
+      }
+    }
+  }
+}
+
+// Generator 1: the same terrain, drawn from one sequential LCG stream per
+// chunk.
+static void chunk_generate_v1(Chunk *chunk, uint64_t seed, int cx, int cy) {
+  if (cy < 0) {
+    return;
+  }
+  uint64_t state = generator_chunk_key(seed, cx, cy);
+  const int start_depth = cy == 0 ? 6 : -GRID_Y;
+  const double stone_chance = Clamp(0.5 + 0.1 * cy, 0.5, 0.95);
+  for (int y = 0; y < GRID_Y; ++y) {
+    for (int x = 0; x < GRID_X; ++x) {
+      if (y < start_depth) {
+        chunk_set(chunk, x, y, BLOCK_TYPE_AIR);
+      } else if (y - start_depth == 0) {
+        chunk_set(chunk, x, y, BLOCK_TYPE_GRASS);
+      } else if (y - start_depth < 2) {
+        chunk_set(chunk, x, y, BLOCK_TYPE_DIRT);
+      } else {
+        state = state * 6364136223846793005ull + 1442695040888963407ull;
+        chunk_set(chunk, x, y, generator_unit(generator_mix(state)) < stone_chance ? BLOCK_TYPE_STONE : BLOCK_TYPE_DIRT);
+      }
+    }
+  }
+}
+
+static inline bool generator_is_known(uint32_t generator) {
+  return generator >= GENERATOR_MIN_VERSION && generator <= GENERATOR_VERSION;
+}
+
+// Generates chunk (cx, cy) the way generator version `generator` does.
+void chunk_generate(Chunk *chunk, uint64_t seed, uint32_t generator, int cx, int cy) {
+  chunk_init(chunk, world_chunk_bounds(cx, cy));
+  switch (generator) {
+  case 1:
+    chunk_generate_v1(chunk, seed, cx, cy);
+    break;
+  case 2:
+    chunk_generate_v2(chunk, seed, cx, cy);
+    break;
+  default:
+    chunk_generate_v3(chunk, seed, cx, cy);
+    break;
+  }
+  chunk_compact(chunk);
+}
+
+#endif
@@ -0,0 +1,143 @@
+#ifndef GENERATOR_H
+#define GENERATOR_H
+
+#include "chunk.h"
+#include "game.h"
+#include "generate.h"
+#include "pool.h"
+#include "world.h"
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <threads.h>
+
+// Background chunk generation. The main thread asks for the chunks it is
+// missing; each is generated into a chunk of its own on the worker pool
+// (pool.h) and pushed onto a lock-free completion stack, from which the
+// main thread moves the finished ones into the world once per frame. The
+// world itself is only ever touched by the main thread.
+
+typedef struct GenerateJob GenerateJob;
+struct GenerateJob {
+  ChunkCoord coord;
+  uint64_t seed;
+  uint32_t generator;
+  uint32_t epoch;
+  Chunk chunk;
+  struct GeneratorService *service;
+  GenerateJob *next;
+};
+
+typedef struct GeneratorService {
+  // Finished jobs, pushed by the workers and taken all at once by the main
+  // thread.
+  _Atomic(GenerateJob *) done;
+  atomic_size_t running; // Queued or running jobs.
+
+  // Owned by the main thread.
+  uint32_t epoch; // Jobs from before the last cancel are dropped.
+  ChunkCoord *pending;
+  size_t n_pending;
+  size_t capacity;
+} GeneratorService;
+
+static void generator_service_task(void *context, size_t index) {
+  (void)index;
+  GenerateJob *job = context;
+  chunk_generate(&job->chunk, job->seed, job->generator, job->coord.x, job->coord.y);
+  GeneratorService *service = job->service;
+  job->next = atomic_load_explicit(&service->done, memory_order_relaxed);
+  while (!atomic_compare_exchange_weak_explicit(&service->done, &job->next, job, memory_order_release,
+                                                memory_order_relaxed)) {
+  }
+  atomic_fetch_sub_explicit(&service->running, 1, memory_order_release);
+}
+
+void generator_service_start(GeneratorService *service) {
+  *service = (GeneratorService){0};
+  atomic_init(&service->done, NULL);
+  atomic_init(&service->running, 0);
+}
+
+// Whether chunk (cx, cy) has been asked for and not collected yet. Only the
+// chunks around the player are ever pending, so a list will do.
+static bool generator_service_is_pending(const GeneratorService *service, int cx, int cy) {
+  for (size_t i = 0; i < service->n_pending; ++i) {
+    if (service->pending[i].x == cx && service->pending[i].y == cy) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Queues the generation of chunk (cx, cy) of `world` unless it is already
+// queued.
+void generator_service_request(GeneratorService *service, const World *world, int cx, int cy) {
+  if (generator_service_is_pending(service, cx, cy)) {
+    return;
+  }
+  if (service->n_pending == service->capacity) {
+    service->capacity = service->capacity ? service->capacity * 2 : 64;
+    service->pending = realloc(service->pending, service->capacity * sizeof(ChunkCoord));
+  }
+  service->pending[service->n_pending++] = (ChunkCoord){cx, cy};
+  GenerateJob *job = calloc(1, sizeof(GenerateJob));
+  job->coord = (ChunkCoord){cx, cy};
+  job->seed = world->seed;
+  job->generator = world->generator;
+  job->epoch = service->epoch;
+  job->service = service;
+  atomic_fetch_add_explicit(&service->running, 1, memory_order_relaxed);
+  pool_spawn(generator_service_task, job);
+}
+
+// Moves every finished chunk into `world`, unless the world got that chunk
+// some other way in the meantime or the job was cancelled. Returns how many
+// were added.
+size_t generator_service_collect(GeneratorService *service, World *world) {
+  GenerateJob *job = atomic_exchange_explicit(&service->done, NULL, memory_order_acquire);
+  size_t added = 0;
+  while (job) {
+    GenerateJob *next = job->next;
+    if (job->epoch == service->epoch) {
+      for (size_t i = 0; i < service->n_pending; ++i) {
+        if (service->pending[i].x == job->coord.x && service->pending[i].y == job->coord.y) {
+          service->pending[i] = service->pending[--service->n_pending];
+          break;
+        }
+      }
+      bool created = false;
+      Chunk *chunk = world_insert_chunk(world, job->coord.x, job->coord.y, &created);
+      if (created) {
+        chunk_move_blocks(chunk, &job->chunk);
+        world_account(world, chunk);
+        added++;
+      }
+    }
+    chunk_free(&job->chunk);
+    free(job);
+    job = next;
+  }
+  return added;
+}
+
+// Forgets every queued chunk, e.g. when the world is replaced. Jobs already
+// running finish but are dropped when collected.
+void generator_service_cancel(GeneratorService *service) {
+  service->epoch++;
+  service->n_pending = 0;
+}
+
+// Waits for every queued job and drops them all.
+void generator_service_stop(GeneratorService *service) {
+  generator_service_cancel(service);
+  while (atomic_load_explicit(&service->running, memory_order_acquire) > 0) {
+    thrd_yield();
+  }
+  generator_service_collect(service, NULL);
+  free(service->pending);
+  *service = (GeneratorService){0};
+}
+
+#endif
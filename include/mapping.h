@@ -0,0 +1,68 @@
+#ifndef MAPPING_H
+#define MAPPING_H
+
+#include "game.h"
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// A world file mapped read-only into memory. Pages are only read in when a
+// chunk stored in them is decoded. Reference counted: the world holds one
+// reference and every snapshot taken while chunks are still undecoded holds
+// another, so saving over the file (which goes through a rename) never pulls
+// it out from under them. Chunks are numbered by directory entry, then by
+// journal record (see world_format_mapped_entry).
+struct WorldMapping {
+  atomic_uint refs;
+  const uint8_t *data;
+  size_t size;
+  uint32_t chunk_count; // Directory entries.
+  size_t *records; // File offset of each journal record.
+  uint32_t n_records;
+};
+
+// Returns NULL if the file cannot be opened or mapped (empty files cannot).
+WorldMapping *world_mapping_open(const char *filename) {
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    return NULL;
+  }
+  struct stat st;
+  void *data = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && st.st_size > 0) {
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  // The mapping outlives the descriptor.
+  close(fd);
+  if (data == MAP_FAILED) {
+    return NULL;
+  }
+  WorldMapping *mapping = calloc(1, sizeof(WorldMapping));
+  atomic_init(&mapping->refs, 1);
+  mapping->data = data;
+  mapping->size = st.st_size;
+  return mapping;
+}
+
+static inline WorldMapping *world_mapping_retain(WorldMapping *mapping) {
+  if (mapping) {
+    atomic_fetch_add_explicit(&mapping->refs, 1, memory_order_relaxed);
+  }
+  return mapping;
+}
+
+// Safe to call from any thread.
+static inline void world_mapping_release(WorldMapping *mapping) {
+  if (mapping && atomic_fetch_sub_explicit(&mapping->refs, 1, memory_order_acq_rel) == 1) {
+    munmap((void *)mapping->data, mapping->size);
+    free(mapping->records);
+    free(mapping);
+  }
+}
+
+#endif
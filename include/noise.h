@@ -0,0 +1,193 @@
+#ifndef NOISE_H
+#define NOISE_H
+
+#include <float.h>
+#include <stdint.h>
+
+#if defined(__SSE2__) && FLT_EVAL_METHOD == 0
+#include <emmintrin.h>
+#define NOISE_SSE2 1
+#else
+#define NOISE_SSE2 0
+#endif
+
+// Multi-octave 2D gradient noise over block coordinates, for terrain
+// (generate.h). noise_row evaluates a run of blocks along a row in one
+// call, four at a time with SSE2 where the target has it. The scalar
+// version does the same float operations in the same order, and fused
+// multiply-adds are off, so both give bit-identical values: a world looks
+// the same whichever path built it. (GCC ignores the pragma but never
+// contracts in ISO C mode.)
+#ifdef __clang__
+#pragma STDC FP_CONTRACT OFF
+#endif
+
+#define NOISE_MAX_OCTAVES 8
+
+// Octave o samples at frequency * 2^o with amplitude 2^-o, from lattice
+// gradients hashed with keys[o]. Values stay within +-2.
+typedef struct {
+  int octaves;
+  float frequency; // Of the first octave, per block.
+  uint32_t keys[NOISE_MAX_OCTAVES];
+} NoiseField;
+
+static inline uint32_t noise_hash(int32_t ix, int32_t iy, uint32_t key) {
+  uint32_t h = (uint32_t)ix * 0x9E3779B1u + (uint32_t)iy * 0x85EBCA77u + key;
+  h ^= h >> 15;
+  h *= 0x2C1B3C6Du;
+  h ^= h >> 12;
+  h *= 0x297A2D39u;
+  h ^= h >> 15;
+  return h;
+}
+
+// Dot product of (fx, fy) with the diagonal gradient picked by `h`.
+static inline float noise_gradient(uint32_t h, float fx, float fy) {
+  float gx = h & 1 ? -fx : fx;
+  float gy = h & 2 ? -fy : fy;
+  return gx + gy;
+}
+
+// 6t^5 - 15t^4 + 10t^3.
+static inline float noise_fade(float t) {
+  float a = t * 6.0f;
+  a = a - 15.0f;
+  a = a * t;
+  a = a + 10.0f;
+  float b = t * t;
+  b = b * t;
+  return b * a;
+}
+
+// Rounds toward minus infinity; `v` must fit an int32_t.
+static inline int32_t noise_floor(float v) {
+  int32_t i = (int32_t)v;
+  return i - ((float)i > v);
+}
+
+static float noise_sample(float x, float y, uint32_t key) {
+  int32_t ix = noise_floor(x), iy = noise_floor(y);
+  float fx = x - (float)ix, fy = y - (float)iy;
+  float fx1 = fx - 1.0f, fy1 = fy - 1.0f;
+  float n00 = noise_gradient(noise_hash(ix, iy, key), fx, fy);
+  float n10 = noise_gradient(noise_hash(ix + 1, iy, key), fx1, fy);
+  float n01 = noise_gradient(noise_hash(ix, iy + 1, key), fx, fy1);
+  float n11 = noise_gradient(noise_hash(ix + 1, iy + 1, key), fx1, fy1);
+  float u = noise_fade(fx), v = noise_fade(fy);
+  float nx0 = n00 + u * (n10 - n00);
+  float nx1 = n01 + u * (n11 - n01);
+  return nx0 + v * (nx1 - nx0);
+}
+
+// Noise at the centres of blocks (x + i, y) for i below `count`.
+void noise_row_scalar(const NoiseField *field, int x, int y, int count, float *out) {
+  for (int i = 0; i < count; ++i) {
+    float sum = 0.0f;
+    float frequency = field->frequency;
+    float amplitude = 1.0f;
+    for (int o = 0; o < field->octaves; ++o) {
+      float sx = ((float)(x + i) + 0.5f) * frequency;
+      float sy = ((float)y + 0.5f) * frequency;
+      sum = sum + amplitude * noise_sample(sx, sy, field->keys[o]);
+      frequency = frequency * 2.0f;
+      amplitude = amplitude * 0.5f;
+    }
+    out[i] = sum;
+  }
+}
+
+#if NOISE_SSE2
+// SSE2 has no 32-bit low multiply; build it from two 32x32->64 ones.
+static inline __m128i noise_mullo(__m128i a, __m128i b) {
+  __m128i even = _mm_mul_epu32(a, b);
+  __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+  return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                            _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+static inline __m128i noise_hash4(__m128i ix, __m128i iy, __m128i key) {
+  __m128i h = _mm_add_epi32(noise_mullo(ix, _mm_set1_epi32((int32_t)0x9E3779B1u)),
+                            noise_mullo(iy, _mm_set1_epi32((int32_t)0x85EBCA77u)));
+  h = _mm_add_epi32(h, key);
+  h = _mm_xor_si128(h, _mm_srli_epi32(h, 15));
+  h = noise_mullo(h, _mm_set1_epi32(0x2C1B3C6D));
+  h = _mm_xor_si128(h, _mm_srli_epi32(h, 12));
+  h = noise_mullo(h, _mm_set1_epi32(0x297A2D39));
+  h = _mm_xor_si128(h, _mm_srli_epi32(h, 15));
+  return h;
+}
+
+// Negating by flipping the sign bit is exactly what the scalar `-` does.
+static inline __m128 noise_gradient4(__m128i h, __m128 fx, __m128 fy) {
+  __m128 sx = _mm_castsi128_ps(_mm_slli_epi32(h, 31));
+  __m128 sy = _mm_castsi128_ps(_mm_slli_epi32(_mm_srli_epi32(h, 1), 31));
+  return _mm_add_ps(_mm_xor_ps(fx, sx), _mm_xor_ps(fy, sy));
+}
+
+static inline __m128 noise_fade4(__m128 t) {
+  __m128 a = _mm_mul_ps(t, _mm_set1_ps(6.0f));
+  a = _mm_sub_ps(a, _mm_set1_ps(15.0f));
+  a = _mm_mul_ps(a, t);
+  a = _mm_add_ps(a, _mm_set1_ps(10.0f));
+  __m128 b = _mm_mul_ps(t, t);
+  b = _mm_mul_ps(b, t);
+  return _mm_mul_ps(b, a);
+}
+
+static inline __m128i noise_floor4(__m128 v) {
+  __m128i i = _mm_cvttps_epi32(v);
+  // The comparison mask is -1 where truncation rounded up.
+  return _mm_add_epi32(i, _mm_castps_si128(_mm_cmpgt_ps(_mm_cvtepi32_ps(i), v)));
+}
+
+static inline __m128 noise_sample4(__m128 x, __m128 y, __m128i key) {
+  const __m128 one = _mm_set1_ps(1.0f);
+  const __m128i one_i = _mm_set1_epi32(1);
+  __m128i ix = noise_floor4(x), iy = noise_floor4(y);
+  __m128i ix1 = _mm_add_epi32(ix, one_i), iy1 = _mm_add_epi32(iy, one_i);
+  __m128 fx = _mm_sub_ps(x, _mm_cvtepi32_ps(ix)), fy = _mm_sub_ps(y, _mm_cvtepi32_ps(iy));
+  __m128 fx1 = _mm_sub_ps(fx, one), fy1 = _mm_sub_ps(fy, one);
+  __m128 n00 = noise_gradient4(noise_hash4(ix, iy, key), fx, fy);
+  __m128 n10 = noise_gradient4(noise_hash4(ix1, iy, key), fx1, fy);
+  __m128 n01 = noise_gradient4(noise_hash4(ix, iy1, key), fx, fy1);
+  __m128 n11 = noise_gradient4(noise_hash4(ix1, iy1, key), fx1, fy1);
+  __m128 u = noise_fade4(fx), v = noise_fade4(fy);
+  __m128 nx0 = _mm_add_ps(n00, _mm_mul_ps(u, _mm_sub_ps(n10, n00)));
+  __m128 nx1 = _mm_add_ps(n01, _mm_mul_ps(u, _mm_sub_ps(n11, n01)));
+  return _mm_add_ps(nx0, _mm_mul_ps(v, _mm_sub_ps(nx1, nx0)));
+}
+
+void noise_row_sse2(const NoiseField *field, int x, int y, int count, float *out) {
+  int i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m128i bx = _mm_add_epi32(_mm_set1_epi32(x + i), _mm_setr_epi32(0, 1, 2, 3));
+    __m128 cx = _mm_add_ps(_mm_cvtepi32_ps(bx), _mm_set1_ps(0.5f));
+    __m128 cy = _mm_set1_ps((float)y + 0.5f);
+    __m128 sum = _mm_setzero_ps();
+    float frequency = field->frequency;
+    float amplitude = 1.0f;
+    for (int o = 0; o < field->octaves; ++o) {
+      __m128 f = _mm_set1_ps(frequency);
+      __m128 n = noise_sample4(_mm_mul_ps(cx, f), _mm_mul_ps(cy, f), _mm_set1_epi32((int32_t)field->keys[o]));
+      sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(amplitude), n));
+      frequency = frequency * 2.0f;
+      amplitude = amplitude * 0.5f;
+    }
+    _mm_storeu_ps(out + i, sum);
+  }
+  noise_row_scalar(field, x + i, y, count - i, out + i);
+}
+#endif
+
+// Noise at the centres of blocks (x + i, y) for i below `count`, on the
+// fastest path this build has.
+static inline void noise_row(const NoiseField *field, int x, int y, int count, float *out) {
+#if NOISE_SSE2
+  noise_row_sse2(field, x, y, count, out);
+#else
+  noise_row_scalar(field, x, y, count, out);
+#endif
+}
+
+#endif
@@ -0,0 +1,164 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <threads.h>
+#include <unistd.h>
+
+// A fixed pool of worker threads for data-parallel loops over chunks.
+// pool_for runs `task` once for every index below `count`, spread over the
+// workers and the calling thread, and returns when all of them are done.
+// Any thread may call it, several at once: the save thread encoding while
+// the main thread decodes simply share the workers. pool_spawn queues a
+// single task and returns without waiting for it.
+
+// Upper bound on workers, whatever the core count.
+#define POOL_MAX_THREADS 64
+// Loops shorter than this run on the calling thread alone.
+#define POOL_MIN_PARALLEL 8
+
+typedef void (*PoolTask)(void *context, size_t index);
+
+typedef struct PoolJob PoolJob;
+struct PoolJob {
+  PoolTask task;
+  void *context;
+  size_t count;
+  atomic_size_t next; // Next index to hand out.
+  int users;          // Threads running the job, under the pool lock.
+  bool detached;      // Freed by the last worker done with it (pool_spawn).
+  PoolJob *next_job;
+};
+
+typedef struct {
+  thrd_t threads[POOL_MAX_THREADS];
+  int n_threads;
+  mtx_t lock;
+  cnd_t work;     // A job was queued.
+  cnd_t finished; // A thread stopped working on a job.
+  PoolJob *jobs;  // Jobs that may still have indices to hand out.
+} WorkerPool;
+
+static WorkerPool worker_pool;
+static once_flag worker_pool_once = ONCE_FLAG_INIT;
+
+// Runs indices of `job` until there are none left.
+static void pool_run_job(PoolJob *job) {
+  size_t i;
+  while ((i = atomic_fetch_add_explicit(&job->next, 1, memory_order_relaxed)) < job->count) {
+    job->task(job->context, i);
+  }
+}
+
+// Takes `job` off the queue if it is still there. Called with the lock
+// held, once the job has handed out its last index.
+static void pool_unlink(WorkerPool *pool, PoolJob *job) {
+  for (PoolJob **link = &pool->jobs; *link; link = &(*link)->next_job) {
+    if (*link == job) {
+      *link = job->next_job;
+      return;
+    }
+  }
+}
+
+static int pool_worker(void *arg) {
+  WorkerPool *pool = arg;
+  mtx_lock(&pool->lock);
+  for (;;) {
+    while (!pool->jobs) {
+      cnd_wait(&pool->work, &pool->lock);
+    }
+    PoolJob *job = pool->jobs;
+    job->users++;
+    mtx_unlock(&pool->lock);
+    pool_run_job(job);
+    mtx_lock(&pool->lock);
+    pool_unlink(pool, job);
+    job->users--;
+    if (job->detached && job->users == 0) {
+      free(job);
+    }
+    cnd_broadcast(&pool->finished);
+  }
+  return 0;
+}
+
+// One worker per core besides the calling thread.
+static void pool_start(void) {
+  WorkerPool *pool = &worker_pool;
+  mtx_init(&pool->lock, mtx_plain);
+  cnd_init(&pool->work);
+  cnd_init(&pool->finished);
+  long cores = sysconf(_SC_NPROCESSORS_ONLN);
+  int n_threads = cores > 1 ? (int)(cores - 1) : 0;
+  if (n_threads > POOL_MAX_THREADS) {
+    n_threads = POOL_MAX_THREADS;
+  }
+  for (int i = 0; i < n_threads; ++i) {
+    if (thrd_create(&pool->threads[i], pool_worker, pool) != thrd_success) {
+      break;
+    }
+    thrd_detach(pool->threads[i]);
+    pool->n_threads++;
+  }
+}
+
+// The process-wide pool, started on first use.
+static inline WorkerPool *pool_get(void) {
+  call_once(&worker_pool_once, pool_start);
+  return &worker_pool;
+}
+
+// Appends `job` to the queue and wakes the workers.
+static void pool_queue(WorkerPool *pool, PoolJob *job) {
+  mtx_lock(&pool->lock);
+  PoolJob **tail = &pool->jobs;
+  while (*tail) {
+    tail = &(*tail)->next_job;
+  }
+  *tail = job;
+  cnd_broadcast(&pool->work);
+  mtx_unlock(&pool->lock);
+}
+
+void pool_for(size_t count, PoolTask task, void *context) {
+  WorkerPool *pool = count >= POOL_MIN_PARALLEL ? pool_get() : NULL;
+  PoolJob job = {.task = task, .context = context, .count = count, .users = 1};
+  atomic_init(&job.next, 0);
+  if (!pool || pool->n_threads == 0) {
+    pool_run_job(&job);
+    return;
+  }
+
+  pool_queue(pool, &job);
+  pool_run_job(&job);
+
+  // Every index has been handed out; wait for the workers still running
+  // theirs before `job` goes out of scope.
+  mtx_lock(&pool->lock);
+  pool_unlink(pool, &job);
+  job.users--;
+  while (job.users > 0) {
+    cnd_wait(&pool->finished, &pool->lock);
+  }
+  mtx_unlock(&pool->lock);
+}
+
+// Runs `task` with index 0 on a worker and returns at once. Without
+// workers it runs here, before returning.
+void pool_spawn(PoolTask task, void *context) {
+  WorkerPool *pool = pool_get();
+  if (pool->n_threads == 0) {
+    task(context, 0);
+    return;
+  }
+  PoolJob *job = malloc(sizeof(PoolJob));
+  *job = (PoolJob){.task = task, .context = context, .count = 1, .detached = true};
+  atomic_init(&job->next, 0);
+  pool_queue(pool, job);
+}
+
+#endif
@@ -0,0 +1,406 @@
+#ifndef REGION_H
+#define REGION_H
+
+#include "chunk.h"
+#include "format.h"
+#include "game.h"
+#include "world.h"
+#include <dirent.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+// Region storage: a world kept as a directory instead of a single file.
+// "level" holds a binary world header with no chunks (grid size and
+// camera), and each r.<rx>.<ry>.region file holds the REGION_SIZE x
+// REGION_SIZE block of chunks starting at chunk (rx * REGION_SIZE,
+// ry * REGION_SIZE). Any one chunk can be read or rewritten through the
+// region's offset table without touching the others.
+//
+//   header     REGION_HEADER_SIZE bytes
+//     char magic[4]      "BBRG"
+//     u16  version       REGION_VERSION
+//     u8   grid_x, grid_y
+//     i32  rx, ry
+//   table      REGION_CHUNKS entries of REGION_ENTRY_SIZE bytes, row-major
+//     u32  payload offset, 0 if the chunk is absent
+//     u32  payload length
+//     u32  capacity      bytes reserved for the payload
+//     u32  codec         ChunkCodec, payloads as in format.h
+//   payloads
+//
+// A rewritten payload that still fits its capacity is overwritten in place;
+// otherwise it moves to the end of the file and its old space is abandoned.
+#define REGION_SIZE 16
+#define REGION_CHUNKS (REGION_SIZE * REGION_SIZE)
+#define REGION_MAGIC "BBRG"
+#define REGION_VERSION 1
+#define REGION_HEADER_SIZE 16
+#define REGION_ENTRY_SIZE 16
+#define REGION_DATA_OFFSET (REGION_HEADER_SIZE + REGION_CHUNKS * REGION_ENTRY_SIZE)
+// Payload space is reserved in multiples of this, so that a chunk that
+// grows a little after an edit can still be rewritten in place.
+#define REGION_SLACK 64
+
+typedef struct {
+  uint32_t offset;
+  uint32_t length;
+  uint32_t capacity;
+  uint32_t codec;
+} RegionEntry;
+
+typedef struct {
+  FILE *file;
+  int32_t rx;
+  int32_t ry;
+  uint64_t end;
+  RegionEntry table[REGION_CHUNKS];
+} RegionFile;
+
+static inline int region_coord(int c) { return floor_div(c, REGION_SIZE); }
+
+static inline int region_index(const RegionFile *region, ChunkCoord coord) {
+  return (coord.y - region->ry * REGION_SIZE) * REGION_SIZE + (coord.x - region->rx * REGION_SIZE);
+}
+
+static inline void region_path(char *out, size_t size, const char *dir, int rx, int ry) {
+  snprintf(out, size, "%s/r.%d.%d.region", dir, rx, ry);
+}
+
+// Whether `path` is a region world rather than a world file.
+static inline bool region_world_exists(const char *path) {
+  DIR *dir = opendir(path);
+  if (dir) {
+    closedir(dir);
+  }
+  return dir != NULL;
+}
+
+static void region_put_entry(uint8_t *p, const RegionEntry *entry) {
+  put_u32(p, entry->offset);
+  put_u32(p + 4, entry->length);
+  put_u32(p + 8, entry->capacity);
+  put_u32(p + 12, entry->codec);
+}
+
+// Writes the header and an empty table to a newly created region file.
+static void region_write_header(const RegionFile *region) {
+  uint8_t header[REGION_DATA_OFFSET] = {0};
+  memcpy(header, REGION_MAGIC, 4);
+  put_u16(header + 4, REGION_VERSION);
+  header[6] = GRID_X;
+  header[7] = GRID_Y;
+  put_u32(header + 8, (uint32_t)region->rx);
+  put_u32(header + 12, (uint32_t)region->ry);
+  fwrite(header, 1, sizeof(header), region->file);
+}
+
+// Opens region (rx, ry) of the region world in `dir`, creating an empty one
+// if `create` is set. Returns false if it is missing or unreadable.
+bool region_open(RegionFile *region, const char *dir, int rx, int ry, bool create) {
+  char path[1024];
+  region_path(path, sizeof(path), dir, rx, ry);
+  *region = (RegionFile){.rx = rx, .ry = ry, .end = REGION_DATA_OFFSET};
+  region->file = fopen(path, "r+b");
+  if (!region->file) {
+    if (!create || !(region->file = fopen(path, "w+b"))) {
+      return false;
+    }
+    region_write_header(region);
+    return true;
+  }
+
+  uint8_t header[REGION_DATA_OFFSET];
+  if (fread(header, 1, sizeof(header), region->file) != sizeof(header) || memcmp(header, REGION_MAGIC, 4) != 0 ||
+      get_u16(header + 4) != REGION_VERSION || header[6] != GRID_X || header[7] != GRID_Y ||
+      (int32_t)get_u32(header + 8) != rx || (int32_t)get_u32(header + 12) != ry) {
+    printf("region file %s is corrupt\n", path);
+    fclose(region->file);
+    return false;
+  }
+  for (int i = 0; i < REGION_CHUNKS; ++i) {
+    const uint8_t *p = header + REGION_HEADER_SIZE + i * REGION_ENTRY_SIZE;
+    RegionEntry *entry = &region->table[i];
+    *entry = (RegionEntry){get_u32(p), get_u32(p + 4), get_u32(p + 8), get_u32(p + 12)};
+    if (entry->offset && (uint64_t)entry->offset + entry->capacity > region->end) {
+      region->end = (uint64_t)entry->offset + entry->capacity;
+    }
+  }
+  return true;
+}
+
+void region_close(RegionFile *region) {
+  if (region->file) {
+    fclose(region->file);
+  }
+  region->file = NULL;
+}
+
+// Starts region (rx, ry) of `dir` over with no chunks, in a temporary file
+// that region_replace moves over the old region once it is written.
+bool region_create(RegionFile *region, const char *dir, int rx, int ry) {
+  char path[1024];
+  char temp[1024];
+  region_path(path, sizeof(path), dir, rx, ry);
+  snprintf(temp, sizeof(temp), "%s.tmp", path);
+  *region = (RegionFile){.rx = rx, .ry = ry, .end = REGION_DATA_OFFSET};
+  region->file = fopen(temp, "w+b");
+  if (!region->file) {
+    return false;
+  }
+  region_write_header(region);
+  return true;
+}
+
+// Closes a region started with region_create and puts it in place.
+static bool region_replace(RegionFile *region, const char *dir) {
+  char path[1024];
+  char temp[1024];
+  region_path(path, sizeof(path), dir, region->rx, region->ry);
+  snprintf(temp, sizeof(temp), "%s.tmp", path);
+  region_close(region);
+  return rename(temp, path) == 0;
+}
+
+static inline bool region_has_chunk(const RegionFile *region, ChunkCoord coord) {
+  return region->table[region_index(region, coord)].offset != 0;
+}
+
+// Reads chunk `coord` into `chunk` (zeroed or initialized). Returns false if
+// the region does not hold it or its payload is corrupt.
+bool region_read_chunk(const RegionFile *region, ChunkCoord coord, Chunk *chunk) {
+  const RegionEntry *slot = &region->table[region_index(region, coord)];
+  if (!slot->offset) {
+    return false;
+  }
+  uint8_t payload[CHUNK_RLE_MAX_SIZE > CHUNK_CELLS ? CHUNK_RLE_MAX_SIZE : CHUNK_CELLS];
+  uint8_t *data = slot->length <= sizeof(payload) ? payload : malloc(slot->length);
+  fseek(region->file, slot->offset, SEEK_SET);
+  bool ok = fread(data, 1, slot->length, region->file) == slot->length;
+  if (ok) {
+    WorldFileEntry entry = {
+        .coord = coord,
+        .bounds = world_chunk_bounds(coord.x, coord.y),
+        .length = slot->length,
+        .codec = slot->codec,
+    };
+    ok = world_format_decode_chunk(data, &entry, chunk);
+  }
+  if (data != payload) {
+    free(data);
+  }
+  return ok;
+}
+
+// Stores an encoded payload for chunk `coord`, touching only its own bytes
+// and table entry. The payload is written before the entry that points at
+// it.
+void region_write_payload(RegionFile *region, ChunkCoord coord, const uint8_t *payload, uint32_t length,
+                          ChunkCodec codec) {
+  int index = region_index(region, coord);
+  RegionEntry entry = region->table[index];
+  if (!entry.offset || length > entry.capacity) {
+    entry.offset = (uint32_t)region->end;
+    entry.capacity = (length + REGION_SLACK - 1) / REGION_SLACK * REGION_SLACK;
+    region->end += entry.capacity;
+  }
+  entry.length = length;
+  entry.codec = codec;
+  fseek(region->file, entry.offset, SEEK_SET);
+  fwrite(payload, 1, length, region->file);
+
+  uint8_t bytes[REGION_ENTRY_SIZE];
+  region_put_entry(bytes, &entry);
+  fseek(region->file, REGION_HEADER_SIZE + index * REGION_ENTRY_SIZE, SEEK_SET);
+  fwrite(bytes, 1, sizeof(bytes), region->file);
+  region->table[index] = entry;
+}
+
+// Reads every chunk of `region` that `world` does not have yet, decoding
+// them on the worker pool. Returns false if one is corrupt.
+bool region_read_missing(const RegionFile *region, World *world) {
+  fseek(region->file, 0, SEEK_END);
+  long size = ftell(region->file);
+  uint8_t *data = malloc(size > 0 ? size : 1);
+  fseek(region->file, 0, SEEK_SET);
+  if (size <= 0 || fread(data, 1, size, region->file) != (size_t)size) {
+    free(data);
+    return false;
+  }
+  WorldFileEntry entries[REGION_CHUNKS];
+  Chunk *chunks[REGION_CHUNKS];
+  size_t count = 0;
+  bool ok = true;
+  for (int i = 0; i < REGION_CHUNKS && ok; ++i) {
+    const RegionEntry *slot = &region->table[i];
+    ChunkCoord coord = {region->rx * REGION_SIZE + i % REGION_SIZE, region->ry * REGION_SIZE + i / REGION_SIZE};
+    if (!slot->offset) {
+      continue;
+    }
+    ok = (uint64_t)slot->offset + slot->length <= (uint64_t)size;
+    if (!ok) {
+      printf("chunk (%d, %d) lies outside its region file\n", coord.x, coord.y);
+      break;
+    }
+    bool created = false;
+    Chunk *chunk = world_insert_chunk(world, coord.x, coord.y, &created);
+    if (created) {
+      entries[count] = (WorldFileEntry){
+          .coord = coord,
+          .bounds = world_chunk_bounds(coord.x, coord.y),
+          .offset = slot->offset,
+          .length = slot->length,
+          .codec = slot->codec,
+      };
+      chunks[count++] = chunk;
+    }
+  }
+  ok = ok && world_format_decode_chunks(data, entries, chunks, count);
+  for (size_t i = 0; i < count; ++i) {
+    chunk_clear_dirty(chunks[i], CHUNK_DIRTY_SAVE);
+  }
+  world_account_chunks(world, chunks, count);
+  free(data);
+  return ok;
+}
+
+typedef struct {
+  int32_t rx;
+  int32_t ry;
+  size_t chunk;
+} RegionWriteOrder;
+
+static int region_compare_order(const void *a, const void *b) {
+  const RegionWriteOrder *oa = a;
+  const RegionWriteOrder *ob = b;
+  if (oa->rx != ob->rx) {
+    return (oa->rx > ob->rx) - (oa->rx < ob->rx);
+  }
+  if (oa->ry != ob->ry) {
+    return (oa->ry > ob->ry) - (oa->ry < ob->ry);
+  }
+  return (oa->chunk > ob->chunk) - (oa->chunk < ob->chunk);
+}
+
+// Whether any chunk in `order`, sorted by region_compare_order, lies in
+// region (rx, ry).
+static bool region_in_order(const RegionWriteOrder *order, size_t count, int rx, int ry) {
+  RegionWriteOrder key = {rx, ry, 0};
+  size_t lo = 0, hi = count;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (region_compare_order(&order[mid], &key) < 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo < count && order[lo].rx == rx && order[lo].ry == ry;
+}
+
+// Removes the region files of `dir` that hold none of the chunks in
+// `order`.
+static void region_remove_stale(const char *dir, const RegionWriteOrder *order, size_t count) {
+  DIR *entries = opendir(dir);
+  if (!entries) {
+    return;
+  }
+  struct dirent *entry;
+  while ((entry = readdir(entries)) != NULL) {
+    int rx, ry;
+    int length = -1;
+    sscanf(entry->d_name, "r.%d.%d.region%n", &rx, &ry, &length);
+    if (length < 0 || entry->d_name[length] != '\0' || region_in_order(order, count, rx, ry)) {
+      continue;
+    }
+    char path[1024];
+    region_path(path, sizeof(path), dir, rx, ry);
+    remove(path);
+  }
+  closedir(entries);
+}
+
+// Closes the region being written by write_snapshot_to_regions, if any.
+static void region_finish(RegionFile *region, const char *dir, bool full) {
+  if (!region->file) {
+    return;
+  }
+  if (!full) {
+    region_close(region);
+  } else if (!region_replace(region, dir)) {
+    printf("failed to replace region (%d, %d) of %s\n", region->rx, region->ry, dir);
+    exit(1);
+  }
+}
+
+// Writes the camera and the chunks of `snapshot` into the region world in
+// `dir`, creating it if needed. Without `full`, chunks the snapshot does not
+// hold are left as they are, so a snapshot of just the changed chunks is a
+// partial save. With it the snapshot is the whole world: every region is
+// rewritten from scratch and region files it has no chunks in are removed.
+// Chunks are encoded on the worker pool first, then each region file is
+// opened once. `progress` (may be NULL) counts the chunks encoded so far.
+void write_snapshot_to_regions(const WorldSnapshot *snapshot, const char *dir, bool full, atomic_size_t *progress) {
+  mkdir(dir, 0755);
+  char path[1024];
+  char temp[1024];
+  snprintf(path, sizeof(path), "%s/level", dir);
+  snprintf(temp, sizeof(temp), "%s/level.tmp", dir);
+  WorldFileHeader header = {
+      .version = WORLD_FORMAT_VERSION,
+      .camera_offset = snapshot->camera.offset,
+      .camera_target = snapshot->camera.target,
+      .generator = snapshot->generator,
+      .seed = snapshot->seed,
+  };
+  uint8_t level[WORLD_HEADER_SIZE];
+  world_format_put_header(level, &header);
+  FILE *file = fopen(temp, "wb");
+  if (!file) {
+    printf("failed to open file %s\n", temp);
+    exit(1);
+  }
+  fwrite(level, 1, sizeof(level), file);
+  fclose(file);
+  if (rename(temp, path) != 0) {
+    printf("failed to replace %s\n", path);
+    exit(1);
+  }
+
+  RegionWriteOrder *order = malloc(snapshot->count * sizeof(RegionWriteOrder));
+  for (size_t i = 0; i < snapshot->count; ++i) {
+    ChunkCoord coord = snapshot->chunks[i].coord;
+    order[i] = (RegionWriteOrder){region_coord(coord.x), region_coord(coord.y), i};
+  }
+  qsort(order, snapshot->count, sizeof(RegionWriteOrder), region_compare_order);
+
+  ChunkPayload *payloads = world_format_encode_payloads(snapshot, WORLD_CODECS_ALL, progress, NULL);
+  RegionFile *region = calloc(1, sizeof(RegionFile));
+  for (size_t i = 0; i < snapshot->count; ++i) {
+    if (!region->file || region->rx != order[i].rx || region->ry != order[i].ry) {
+      region_finish(region, dir, full);
+      bool opened = full ? region_create(region, dir, order[i].rx, order[i].ry)
+                         : region_open(region, dir, order[i].rx, order[i].ry, true);
+      if (!opened) {
+        printf("failed to open region (%d, %d) of %s\n", order[i].rx, order[i].ry, dir);
+        exit(1);
+      }
+    }
+    const ChunkPayload *payload = &payloads[order[i].chunk];
+    region_write_payload(region, snapshot->chunks[order[i].chunk].coord, payload->bytes, payload->length,
+                         payload->codec);
+  }
+  region_finish(region, dir, full);
+  free(region);
+  if (full) {
+    region_remove_stale(dir, order, snapshot->count);
+  }
+  free(payloads);
+  free(order);
+}
+
+#endif
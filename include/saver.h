@@ -0,0 +1,201 @@
+#ifndef SAVER_H
+#define SAVER_H
+
+#include "game.h"
+#include "serialize.h"
+#include "stream.h"
+#include "world.h"
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+
+// Background saves. The main thread only takes a snapshot of the world and
+// queues it; a worker thread encodes and writes it (through a temporary file
+// and a rename, or by appending a journal segment), so the game keeps
+// running while a large world is saved. Jobs run one at a time, in order.
+
+typedef enum {
+  SAVE_JOB_FULL,         // Rewrite the whole file.
+  SAVE_JOB_APPEND,       // Append the snapshot's chunks to the journal.
+  SAVE_JOB_REGIONS,      // Write the snapshot's chunks into a region world.
+  SAVE_JOB_REGIONS_FULL, // Replace a region world with the snapshot.
+  SAVE_JOB_DELTA,        // Rewrite a delta world (delta.h).
+} SaveJobKind;
+
+typedef struct SaveJob SaveJob;
+struct SaveJob {
+  SaveJobKind kind;
+  WorldSnapshot snapshot;
+  char *filename;
+  // The world's record of the file when the job was queued.
+  uint64_t file_base;
+  uint64_t file_end;
+  SaveJob *next;
+};
+
+typedef struct {
+  thrd_t thread;
+  mtx_t lock;
+  cnd_t changed; // Jobs were queued or finished, or the service is stopping.
+  SaveJob *head;
+  SaveJob *tail;
+  size_t pending; // Queued and running jobs.
+  bool stopping;
+
+  // Chunks of the running job encoded so far, out of `total`.
+  atomic_size_t done;
+  atomic_size_t total;
+
+  // The file written last and its extent once that job finished. Appends to
+  // it continue from here rather than from what the world knew when the job
+  // was queued, which may predate jobs still in flight.
+  char *file;
+  uint64_t file_base;
+  uint64_t file_end;
+} SaveService;
+
+static int save_service_run(void *arg) {
+  SaveService *saver = arg;
+  mtx_lock(&saver->lock);
+  for (;;) {
+    while (!saver->head && !saver->stopping) {
+      cnd_wait(&saver->changed, &saver->lock);
+    }
+    SaveJob *job = saver->head;
+    if (!job) {
+      break;
+    }
+    saver->head = job->next;
+    if (!saver->head) {
+      saver->tail = NULL;
+    }
+    uint64_t base = job->file_base;
+    uint64_t end = job->file_end;
+    if (saver->file && strcmp(saver->file, job->filename) == 0) {
+      base = saver->file_base;
+      end = saver->file_end;
+    }
+    atomic_store(&saver->done, 0);
+    atomic_store(&saver->total, job->snapshot.count);
+    mtx_unlock(&saver->lock);
+
+    if (job->kind == SAVE_JOB_FULL) {
+      base = end = write_snapshot_to_file(&job->snapshot, job->filename, &saver->done);
+    } else if (job->kind == SAVE_JOB_APPEND) {
+      end = append_snapshot_to_file(&job->snapshot, job->filename, end, &saver->done);
+    } else if (job->kind == SAVE_JOB_DELTA) {
+      write_snapshot_to_delta_file(&job->snapshot, job->filename, &saver->done);
+      base = end = 0;
+    } else {
+      write_snapshot_to_regions(&job->snapshot, job->filename, job->kind == SAVE_JOB_REGIONS_FULL, &saver->done);
+      base = end = 0;
+    }
+    world_snapshot_release(&job->snapshot);
+
+    mtx_lock(&saver->lock);
+    free(saver->file);
+    saver->file = job->filename;
+    saver->file_base = base;
+    saver->file_end = end;
+    saver->pending--;
+    cnd_broadcast(&saver->changed);
+    free(job);
+  }
+  mtx_unlock(&saver->lock);
+  return 0;
+}
+
+void save_service_start(SaveService *saver) {
+  *saver = (SaveService){0};
+  mtx_init(&saver->lock, mtx_plain);
+  cnd_init(&saver->changed);
+  if (thrd_create(&saver->thread, save_service_run, saver) != thrd_success) {
+    printf("failed to start the save thread\n");
+    exit(1);
+  }
+}
+
+// Queues a save of `world` to `filename` and returns at once. Only the
+// snapshot is taken here, so the world may be edited, cleared or reloaded
+// while the save runs.
+void save_service_save(SaveService *saver, const Camera2D *camera, World *world, const char *filename) {
+  // Snapshots must hold the whole world, unless only its changed chunks are
+  // written back to the region world still streaming in.
+  if (save_needs_whole_world(world, filename) && !world_stream_finish(world)) {
+    exit(1);
+  }
+  SaveJob *job = calloc(1, sizeof(SaveJob));
+  job->filename = strdup(filename);
+  job->file_base = world->file_base;
+  job->file_end = world->file_end;
+  if (region_world_exists(filename)) {
+    bool partial = save_is_partial(world, filename);
+    job->kind = partial ? SAVE_JOB_REGIONS : SAVE_JOB_REGIONS_FULL;
+    job->snapshot = partial ? world_snapshot_take_dirty(world, camera) : world_snapshot_take(world, camera);
+    world_set_region_file(world, filename);
+  } else if (save_is_delta(filename)) {
+    job->kind = SAVE_JOB_DELTA;
+    job->snapshot = world_snapshot_take(world, camera);
+    world_set_delta_file(world);
+  } else if (save_should_append(world, filename)) {
+    job->kind = SAVE_JOB_APPEND;
+    job->snapshot = world_snapshot_take_dirty(world, camera);
+  } else {
+    job->kind = SAVE_JOB_FULL;
+    job->snapshot = world_snapshot_take(world, camera);
+    free(world->file);
+    world->file = strdup(filename);
+    world->file_base = world->file_end = 0;
+  }
+
+  mtx_lock(&saver->lock);
+  if (saver->tail) {
+    saver->tail->next = job;
+  } else {
+    saver->head = job;
+  }
+  saver->tail = job;
+  saver->pending++;
+  cnd_broadcast(&saver->changed);
+  mtx_unlock(&saver->lock);
+}
+
+// Brings the world's record of its file up to date with finished saves.
+// Call once per frame.
+void save_service_poll(SaveService *saver, World *world) {
+  mtx_lock(&saver->lock);
+  if (saver->file && world->file && strcmp(saver->file, world->file) == 0) {
+    world->file_base = saver->file_base;
+    world->file_end = saver->file_end;
+  }
+  mtx_unlock(&saver->lock);
+}
+
+// Whether a save is queued or running; if so `fraction` is how far the
+// running one has got.
+bool save_service_progress(SaveService *saver, float *fraction) {
+  mtx_lock(&saver->lock);
+  size_t pending = saver->pending;
+  mtx_unlock(&saver->lock);
+  size_t total = atomic_load(&saver->total);
+  *fraction = total ? (float)atomic_load(&saver->done) / total : 0.0f;
+  return pending > 0;
+}
+
+// Finishes every queued save, then stops the worker.
+void save_service_stop(SaveService *saver) {
+  mtx_lock(&saver->lock);
+  saver->stopping = true;
+  cnd_broadcast(&saver->changed);
+  mtx_unlock(&saver->lock);
+  thrd_join(saver->thread, NULL);
+  mtx_destroy(&saver->lock);
+  cnd_destroy(&saver->changed);
+  free(saver->file);
+  *saver = (SaveService){0};
+}
+
+#endif
@@ -1,51 +1,653 @@
 #ifndef SERIALIZE_H
 #define SERIALIZE_H
 
+#include "chunk.h"
+#include "delta.h"
+#include "format.h"
 #include "game.h"
+#include "mapping.h"
+#include "region.h"
+#include "stream.h"
+#include "world.h"
+#include <stdatomic.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
 
-void write_world_to_file(Camera2D *camera, Chunk *chunks, const char *filename) {
+// Legacy text format: "Camera <offset.x> " followed by one
+// "Chunk { x, y, w, h } = {\n<cells>\n}\n" block per chunk. Kept so old
+// worlds can be read back and compared; new saves use the binary format.
+void write_snapshot_to_text_file(const WorldSnapshot *snapshot, const char *filename) {
   FILE *file = fopen(filename, "w");
   if (!file) {
     printf("failed to open file %s\n", filename);
     exit(1);
   }
-  fprintf(file, "Camera %f ", camera->offset.x);
-  for (int i = 0; i < N_CHUNKS; ++i) {
-    Chunk *chunk = &chunks[i];
+  fprintf(file, "Camera %f ", snapshot->camera.offset.x);
+  for (size_t i = 0; i < snapshot->count; ++i) {
+    const Chunk *chunk = &snapshot->chunks[i];
+    Chunk decoded = {0};
+    if (snapshot->entries && snapshot->entries[i] != CHUNK_NO_ENTRY) {
+      WorldFileEntry entry;
+      world_format_mapped_entry(snapshot->mapping, snapshot->entries[i], &entry);
+      world_format_decode_chunk(snapshot->mapping->data, &entry, &decoded);
+      chunk = &decoded;
+    }
     fprintf(file, "Chunk { %f, %f, %f, %f } = {\n", chunk->bounds.x, chunk->bounds.y, chunk->bounds.width, chunk->bounds.height);
-    for (int y = 0; y < GRID_Y; ++y) {
-      for (int x = 0; x < GRID_X; ++x) {
-        fprintf(file, "%d, ", chunk->blocks[y][x]);
+    if (chunk_is_uniform(chunk)) {
+      // Every cell prints the same; format one and repeat it.
+      char cell[16];
+      int length = snprintf(cell, sizeof(cell), "%d, ", chunk_uniform_type(chunk));
+      char cells[CHUNK_CELLS * sizeof(cell)];
+      for (int c = 0; c < CHUNK_CELLS; ++c) {
+        memcpy(cells + c * length, cell, length);
+      }
+      fwrite(cells, length, CHUNK_CELLS, file);
+    } else {
+      for (int y = 0; y < GRID_Y; ++y) {
+        BlockType row[GRID_X];
+        chunk_get_row(chunk, y, row);
+        for (int x = 0; x < GRID_X; ++x) {
+          fprintf(file, "%d, ", row[x]);
+        }
       }
     }
     fprintf(file, "\n}\n");
+    chunk_free(&decoded);
   }
   fclose(file);
 }
 
+// Reads a whole file in one go, NUL-terminated so that text can be parsed in
+// place. Returns NULL if it cannot be opened.
+uint8_t *read_file_bytes(const char *filename, size_t *size) {
+  FILE *file = fopen(filename, "rb");
+  if (!file) {
+    return NULL;
+  }
+  fseek(file, 0, SEEK_END);
+  long length = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  uint8_t *data = malloc(length > 0 ? length + 1 : 1);
+  *size = fread(data, 1, length > 0 ? length : 0, file);
+  data[*size] = '\0';
+  fclose(file);
+  return data;
+}
+
+// Cursor over NUL-terminated text that follows fscanf's rules, so that the
+// legacy format parses exactly as it used to: whitespace in a pattern
+// matches any run of whitespace, including none, and numbers skip leading
+// whitespace. Like fscanf, a failed match leaves the cursor where the input
+// stopped matching.
+typedef struct {
+  const char *p;
+} TextCursor;
+
+static inline bool text_is_space(char c) { return c == ' ' || (c >= '\t' && c <= '\r'); }
+
+static inline void text_skip_space(TextCursor *text) {
+  while (text_is_space(*text->p)) {
+    text->p++;
+  }
+}
+
+static inline bool text_match(TextCursor *text, const char *pattern) {
+  for (; *pattern; ++pattern) {
+    if (text_is_space(*pattern)) {
+      text_skip_space(text);
+    } else if (*text->p == *pattern) {
+      text->p++;
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+static inline bool text_int(TextCursor *text, int *value) {
+  text_skip_space(text);
+  const char *p = text->p;
+  bool negative = *p == '-';
+  if (*p == '-' || *p == '+') {
+    p++;
+  }
+  if (*p < '0' || *p > '9') {
+    return false;
+  }
+  int n = 0;
+  while (*p >= '0' && *p <= '9') {
+    n = n * 10 + (*p++ - '0');
+  }
+  *value = negative ? -n : n;
+  text->p = p;
+  return true;
+}
+
+static inline bool text_float(TextCursor *text, float *value) {
+  text_skip_space(text);
+  char *end;
+  *value = strtof(text->p, &end);
+  if (end == text->p) {
+    return false;
+  }
+  text->p = end;
+  return true;
+}
+
+// Legacy text format, parsed in a single pass over `text`: reads chunks
+// until the end of the input; legacy worlds hold 24 of them. Each chunk's
+// cells go straight into chunk_load_cells.
+void read_world_from_text(Camera2D *camera, World *world, const char *text) {
+  TextCursor cursor = {text};
+  if (text_match(&cursor, "Camera ") && text_float(&cursor, &camera->offset.x)) {
+    text_skip_space(&cursor);
+  }
+  world_clear(world);
+  Rectangle bounds = {0};
+  while (text_match(&cursor, "Chunk { ") && text_float(&cursor, &bounds.x) && text_match(&cursor, ", ") &&
+         text_float(&cursor, &bounds.y) && text_match(&cursor, ", ") && text_float(&cursor, &bounds.width) &&
+         text_match(&cursor, ", ") && text_float(&cursor, &bounds.height)) {
+    text_match(&cursor, " } = {\n");
+    BlockId cells[CHUNK_CELLS];
+    for (int i = 0; i < CHUNK_CELLS; ++i) {
+      int block = BLOCK_TYPE_AIR;
+      if (text_int(&cursor, &block)) {
+        text_match(&cursor, ", ");
+      }
+      cells[i] = (BlockId)block;
+    }
+    Chunk *chunk = world_insert_chunk(world, world_chunk_x(bounds.x), world_chunk_y(bounds.y), NULL);
+    chunk->bounds = bounds;
+    chunk_load_cells(chunk, cells);
+    world_account(world, chunk);
+    text_match(&cursor, "\n}\n");
+  }
+  world_clear_save_dirty(world);
+}
+
+void read_world_from_text_file(Camera2D *camera, World *world, const char *filename) {
+  size_t size = 0;
+  char *text = (char *)read_file_bytes(filename, &size);
+  if (!text) {
+    printf("failed to open file %s\n", filename);
+    exit(1);
+  }
+  read_world_from_text(camera, world, text);
+  free(text);
+}
 
-void read_world_from_file(Camera2D *camera, Chunk *chunks, const char *filename) {
-  FILE *file = fopen(filename, "r");
+// Replaces `filename` with `buffer` through a temporary file and a rename,
+// so that a crash never leaves a torn file behind.
+static void replace_file_contents(const char *filename, const ByteBuffer *buffer) {
+  char temp[1024];
+  snprintf(temp, sizeof(temp), "%s.tmp", filename);
+  FILE *file = fopen(temp, "wb");
+  if (!file) {
+    printf("failed to open file %s\n", temp);
+    exit(1);
+  }
+  fwrite(buffer->data, 1, buffer->size, file);
+  fclose(file);
+  if (rename(temp, filename) != 0) {
+    printf("failed to replace %s\n", filename);
+    exit(1);
+  }
+}
+
+// Only reads `snapshot`, so it may run on another thread while the game
+// keeps editing the live world. The file is encoded in memory, written with
+// a single fwrite to a temporary file and renamed over `filename`: the old
+// file may still be mapped (see read_world_from_file) and must not change
+// under the mapping. Returns the size of the file. `progress` (may be NULL)
+// counts the chunks encoded so far.
+size_t write_snapshot_to_file(const WorldSnapshot *snapshot, const char *filename, atomic_size_t *progress) {
+  ByteBuffer buffer = {0};
+  world_format_encode(snapshot, WORLD_CODECS_ALL, &buffer, progress);
+  replace_file_contents(filename, &buffer);
+  size_t size = buffer.size;
+  byte_buffer_free(&buffer);
+  return size;
+}
+
+// Writes `snapshot` as a delta file (delta.h). Returns the file size.
+size_t write_snapshot_to_delta_file(const WorldSnapshot *snapshot, const char *filename, atomic_size_t *progress) {
+  ByteBuffer buffer = {0};
+  delta_encode(snapshot, &buffer, progress);
+  replace_file_contents(filename, &buffer);
+  size_t size = buffer.size;
+  byte_buffer_free(&buffer);
+  return size;
+}
+
+// Appends the chunks of `snapshot` as one journal segment to `filename`,
+// whose valid contents end at `end`; a segment torn by an earlier crash past
+// that point is overwritten. Returns the new end of the file.
+uint64_t append_snapshot_to_file(const WorldSnapshot *snapshot, const char *filename, uint64_t end,
+                                 atomic_size_t *progress) {
+  ByteBuffer buffer = {0};
+  world_format_encode_segment(snapshot, WORLD_CODECS_ALL, &buffer, progress);
+  FILE *file = fopen(filename, "r+b");
   if (!file) {
     printf("failed to open file %s\n", filename);
     exit(1);
   }
-  fscanf(file, "Camera %f ", &camera->offset.x);
-  for (int i = 0; i < N_CHUNKS; ++i) {
-    Chunk *chunk = &chunks[i];
-    fscanf(file, "Chunk { %f, %f, %f, %f } = {\n", &chunk->bounds.x, &chunk->bounds.y, &chunk->bounds.width, &chunk->bounds.height);
-    for (int y = 0; y < GRID_Y; ++y) {
-      for (int x = 0; x < GRID_X; ++x) {
-        fscanf(file, "%d, ", &chunk->blocks[y][x]);
+  fseek(file, (long)end, SEEK_SET);
+  fwrite(buffer.data, 1, buffer.size, file);
+  fclose(file);
+  end += buffer.size;
+  byte_buffer_free(&buffer);
+  return end;
+}
+
+// Writes the whole world, leaving `filename` without a journal.
+void write_world_to_file(Camera2D *camera, World *world, const char *filename) {
+  WorldSnapshot snapshot = world_snapshot_take(world, camera);
+  size_t size = write_snapshot_to_file(&snapshot, filename, NULL);
+  world_snapshot_release(&snapshot);
+  free(world->file);
+  world->file = strdup(filename);
+  world->file_base = world->file_end = size;
+}
+
+// Whether saving `world` to `filename` should only append the chunks changed
+// since the last save, as a journal segment. That is the case when saving
+// back to the file the world came from, until the journal has grown past
+// half of the base image; the file is then compacted by rewriting it whole.
+static inline bool save_should_append(const World *world, const char *filename) {
+  return world->file && strcmp(world->file, filename) == 0 &&
+         world->file_end - world->file_base <= world->file_base / 2;
+}
+
+// Region worlds (region.h) are saved chunk by chunk, and only the chunks
+// changed since the last save need writing when saving back to the world
+// they were loaded from.
+static inline bool save_is_partial(const World *world, const char *filename) {
+  return world->file && strcmp(world->file, filename) == 0;
+}
+
+// Whether `filename` is a delta world file (delta.h). Delta worlds stay
+// delta worlds: they are rewritten whole, as a delta, on every save.
+static inline bool save_is_delta(const char *filename) {
+  uint8_t magic[4];
+  FILE *file = fopen(filename, "rb");
+  size_t size = file ? fread(magic, 1, sizeof(magic), file) : 0;
+  if (file) {
+    fclose(file);
+  }
+  return delta_format_is_delta(magic, size);
+}
+
+// Records that `world` is now stored as the delta world `filename`, which
+// has no extent to append to.
+static inline void world_set_delta_file(World *world) {
+  free(world->file);
+  world->file = NULL;
+  world->file_base = world->file_end = 0;
+}
+
+// Whether saving `world` to `filename` needs the regions still streaming
+// in. Every save does but a partial one back into the region world they
+// come from: they are unchanged there, so it can leave them unread.
+static inline bool save_needs_whole_world(const World *world, const char *filename) {
+  return !save_is_partial(world, filename) || !region_world_exists(filename);
+}
+
+// Records that `world` is now stored as the region world `dir`.
+static inline void world_set_region_file(World *world, const char *dir) {
+  if (!world->file || strcmp(world->file, dir) != 0) {
+    free(world->file);
+    world->file = strdup(dir);
+  }
+  world->file_base = world->file_end = 0;
+}
+
+// Saves `world` to `filename` on the calling thread (see saver.h for
+// background saves). Regions still streaming in are read first when the
+// save must hold the whole world.
+void save_world(Camera2D *camera, World *world, const char *filename) {
+  if (save_needs_whole_world(world, filename) && !world_stream_finish(world)) {
+    exit(1);
+  }
+  if (region_world_exists(filename)) {
+    bool partial = save_is_partial(world, filename);
+    WorldSnapshot snapshot = partial ? world_snapshot_take_dirty(world, camera) : world_snapshot_take(world, camera);
+    write_snapshot_to_regions(&snapshot, filename, !partial, NULL);
+    world_snapshot_release(&snapshot);
+    world_set_region_file(world, filename);
+  } else if (save_is_delta(filename)) {
+    WorldSnapshot snapshot = world_snapshot_take(world, camera);
+    write_snapshot_to_delta_file(&snapshot, filename, NULL);
+    world_snapshot_release(&snapshot);
+    world_set_delta_file(world);
+  } else if (save_should_append(world, filename)) {
+    WorldSnapshot snapshot = world_snapshot_take_dirty(world, camera);
+    world->file_end = append_snapshot_to_file(&snapshot, filename, world->file_end, NULL);
+    world_snapshot_release(&snapshot);
+  } else {
+    write_world_to_file(camera, world, filename);
+  }
+}
+
+// Records where the base image and the journal of a freshly loaded binary
+// world end. Files from older versions are never appended to, so that
+// older builds do not miss the journal.
+static void world_set_file_extent(World *world, const WorldFileHeader *header, size_t base, size_t end) {
+  if (header->version == WORLD_FORMAT_VERSION) {
+    world->file_base = base;
+    world->file_end = end;
+  }
+}
+
+// Appends `entry` to the `count` entries in `*entries`.
+static void push_world_entry(WorldFileEntry **entries, size_t *count, size_t *capacity, const WorldFileEntry *entry) {
+  if (*count == *capacity) {
+    *capacity = *capacity ? *capacity * 2 : 256;
+    *entries = realloc(*entries, *capacity * sizeof(WorldFileEntry));
+  }
+  (*entries)[(*count)++] = *entry;
+}
+
+// Replaces the contents of `world` with the binary world in `data`, journal
+// included. The directory and journal are read first; then every chunk is
+// created from the last entry that holds it and all of them are decoded on
+// the worker pool.
+bool read_world_from_binary(Camera2D *camera, World *world, const uint8_t *data, size_t size) {
+  WorldFileHeader header;
+  if (!world_format_parse_header(data, size, &header)) {
+    return false;
+  }
+  camera->offset = header.camera_offset;
+  camera->target = header.camera_target;
+  world_clear(world);
+  if (!world_restore_generator(world, &header)) {
+    return false;
+  }
+  WorldFileEntry *entries = NULL;
+  size_t count = 0, capacity = 0;
+  bool ok = true;
+  size_t base = world_format_header_size(header.version) + (size_t)header.chunk_count * WORLD_ENTRY_SIZE;
+  for (uint32_t i = 0; i < header.chunk_count && ok; ++i) {
+    WorldFileEntry entry;
+    ok = world_format_parse_entry(data, size, i, &entry);
+    if (!ok) {
+      printf("chunk %u lies outside the world file\n", i);
+      break;
+    }
+    push_world_entry(&entries, &count, &capacity, &entry);
+    if (world_format_entry_end(&entry) > base) {
+      base = world_format_entry_end(&entry);
+    }
+  }
+
+  size_t end = base;
+  WorldJournalSegment segment;
+  while (ok && world_format_parse_segment(data, size, end, &segment)) {
+    camera->offset = segment.camera_offset;
+    camera->target = segment.camera_target;
+    size_t offset = segment.records;
+    for (uint32_t i = 0; i < segment.chunk_count && ok; ++i) {
+      WorldFileEntry entry;
+      ok = world_format_parse_record(data, segment.records_end, &offset, &entry);
+      if (!ok) {
+        printf("journal record %u at %zu is corrupt\n", i, end);
+        break;
       }
+      push_world_entry(&entries, &count, &capacity, &entry);
     }
-    fscanf(file, "\n}\n");
+    end = segment.end;
   }
-  fclose(file);
+
+  // Later entries replace earlier ones: going backwards, only the first
+  // entry seen for a chunk creates it. The entries kept are packed at the
+  // end of the array, behind the ones still to be looked at.
+  Chunk **chunks = malloc((count ? count : 1) * sizeof(Chunk *));
+  size_t first = count;
+  world_reserve(world, count);
+  for (size_t i = count; ok && i-- > 0;) {
+    bool created = false;
+    Chunk *chunk = world_insert_chunk(world, entries[i].coord.x, entries[i].coord.y, &created);
+    if (created) {
+      entries[--first] = entries[i];
+      chunks[first] = chunk;
+    }
+  }
+  ok = ok && world_format_decode_chunks(data, entries + first, chunks + first, count - first);
+  world_account_chunks(world, chunks + first, count - first);
+  free(chunks);
+  free(entries);
+  if (!ok) {
+    return false;
+  }
+  world_clear_save_dirty(world);
+  world_set_file_extent(world, &header, base, end);
+  return true;
+}
+
+// Replaces the contents of `world` with the chunks of the binary world in
+// `mapping`, taking over the caller's reference. Only the header, directory
+// and journal records are read; chunks are decoded as they are touched.
+bool map_world(Camera2D *camera, World *world, WorldMapping *mapping) {
+  WorldFileHeader header;
+  if (!world_format_parse_header(mapping->data, mapping->size, &header)) {
+    world_mapping_release(mapping);
+    return false;
+  }
+  camera->offset = header.camera_offset;
+  camera->target = header.camera_target;
+  world_clear(world);
+  if (!world_restore_generator(world, &header)) {
+    world_mapping_release(mapping);
+    return false;
+  }
+  world->mapping = mapping;
+  world_reserve(world, header.chunk_count);
+  mapping->chunk_count = header.chunk_count;
+  size_t base = world_format_header_size(header.version) + (size_t)header.chunk_count * WORLD_ENTRY_SIZE;
+  for (uint32_t i = 0; i < header.chunk_count; ++i) {
+    WorldFileEntry entry;
+    if (!world_format_parse_entry(mapping->data, mapping->size, i, &entry)) {
+      printf("chunk %u lies outside the world file\n", i);
+      return false;
+    }
+    world_insert_mapped(world, entry.coord.x, entry.coord.y, i);
+    if (world_format_entry_end(&entry) > base) {
+      base = world_format_entry_end(&entry);
+    }
+  }
+
+  size_t end = base;
+  uint32_t capacity = 0;
+  WorldJournalSegment segment;
+  while (world_format_parse_segment(mapping->data, mapping->size, end, &segment)) {
+    camera->offset = segment.camera_offset;
+    camera->target = segment.camera_target;
+    size_t offset = segment.records;
+    for (uint32_t i = 0; i < segment.chunk_count; ++i) {
+      size_t record = offset;
+      WorldFileEntry entry;
+      if (!world_format_parse_record(mapping->data, segment.records_end, &offset, &entry)) {
+        printf("journal record %u at %zu is corrupt\n", i, end);
+        return false;
+      }
+      if (mapping->n_records == capacity) {
+        capacity = capacity ? capacity * 2 : 64;
+        mapping->records = realloc(mapping->records, capacity * sizeof(size_t));
+      }
+      mapping->records[mapping->n_records] = record;
+      world_insert_mapped(world, entry.coord.x, entry.coord.y, header.chunk_count + mapping->n_records++);
+    }
+    end = segment.end;
+  }
+  world_set_file_extent(world, &header, base, end);
+  return true;
+}
+
+// Loads a world file in any format, telling them apart by their magic
+// numbers, or a region world directory. Binary worlds are mapped, so
+// startup does not grow with the size of the chunk payloads; worlds that
+// cannot be mapped are read in full. With `stream`, region worlds are only
+// opened and everything but the chunks around the saved camera is left to
+// world_stream_step (stream.h). Returns false if the world cannot be read.
+static bool load_world_file(Camera2D *camera, World *world, const char *filename, bool stream) {
+  bool ok = true;
+  bool regions = region_world_exists(filename);
+  if (regions) {
+    ok = stream ? stream_world_from_regions(camera, world, filename)
+                : read_world_from_regions(camera, world, filename);
+  } else {
+    WorldMapping *mapping = world_mapping_open(filename);
+    if (mapping && world_format_is_binary(mapping->data, mapping->size)) {
+      ok = map_world(camera, world, mapping);
+    } else {
+      world_mapping_release(mapping);
+      size_t size = 0;
+      uint8_t *data = read_file_bytes(filename, &size);
+      if (!data) {
+        printf("failed to open file %s\n", filename);
+        return false;
+      }
+      if (world_format_is_binary(data, size)) {
+        ok = read_world_from_binary(camera, world, data, size);
+      } else if (delta_format_is_delta(data, size)) {
+        ok = delta_decode(camera, world, data, size);
+      } else {
+        read_world_from_text(camera, world, (const char *)data);
+      }
+      free(data);
+    }
+  }
+  if (!ok) {
+    printf("failed to load world %s\n", filename);
+    return false;
+  }
+  // Only current binary files get an extent; saves rewrite the others whole.
+  if (regions) {
+    world_set_region_file(world, filename);
+  } else if (world->file_end) {
+    world->file = strdup(filename);
+  }
+  if (stream) {
+    ChunkCoord center = {world_chunk_x(camera->target.x), world_chunk_y(camera->target.y)};
+    if (world->mapping) {
+      world_stream_queue_mapped(world, center);
+    }
+    world_stream_step(world, camera->target, 0.0);
+  }
+  return true;
 }
 
+void read_world_from_file(Camera2D *camera, World *world, const char *filename) {
+  if (!load_world_file(camera, world, filename, false)) {
+    exit(1);
+  }
+}
+
+// Like read_world_from_file, but returns once the chunks around the saved
+// camera are in; call world_stream_step every frame for the rest. Returns
+// false if the world cannot be read.
+bool stream_world_from_file(Camera2D *camera, World *world, const char *filename) {
+  return load_world_file(camera, world, filename, true);
+}
+
+// Loads a world, journal included, and rewrites it as a single base image.
+bool compact_world_file(const char *filename) {
+  if (region_world_exists(filename)) {
+    printf("%s: region worlds have no journal\n", filename);
+    return true;
+  }
+  Camera2D camera = {0};
+  World world;
+  world_init(&world);
+  read_world_from_file(&camera, &world, filename);
+  uint64_t before = world.file_end;
+  write_world_to_file(&camera, &world, filename);
+  printf("%s: compacted %zu chunks, %llu -> %llu bytes\n", filename, world.count, (unsigned long long)before,
+         (unsigned long long)world.file_end);
+  world_free(&world);
+  return true;
+}
+
+// Rewrites a legacy text world in the binary format, in place. Files that
+// are already binary are left alone. Returns false if the file could not be
+// converted.
+bool convert_world_file(const char *filename) {
+  size_t size = 0;
+  uint8_t *data = read_file_bytes(filename, &size);
+  if (!data) {
+    printf("failed to open file %s\n", filename);
+    return false;
+  }
+  bool binary = world_format_is_binary(data, size);
+  free(data);
+  if (binary) {
+    printf("%s: already binary\n", filename);
+    return true;
+  }
+
+  Camera2D camera = {0};
+  World world;
+  world_init(&world);
+  read_world_from_text_file(&camera, &world, filename);
+
+  write_world_to_file(&camera, &world, filename);
+  printf("%s: converted %zu chunks\n", filename, world.count);
+  world_free(&world);
+  return true;
+}
+
+// Rewrites a world file as a delta world (delta.h), in place. Only chunks
+// that differ from what the world's generator gives are kept.
+bool convert_world_to_delta(const char *filename) {
+  if (region_world_exists(filename)) {
+    printf("%s: region worlds cannot be stored as deltas\n", filename);
+    return false;
+  }
+  Camera2D camera = {0};
+  World world;
+  world_init(&world);
+  read_world_from_file(&camera, &world, filename);
+  struct stat st;
+  uint64_t before = stat(filename, &st) == 0 ? (uint64_t)st.st_size : 0;
+  WorldSnapshot snapshot = world_snapshot_take(&world, &camera);
+  size_t after = write_snapshot_to_delta_file(&snapshot, filename, NULL);
+  world_snapshot_release(&snapshot);
+  printf("%s: %zu chunks, %llu -> %zu bytes as a delta\n", filename, world.count, (unsigned long long)before, after);
+  world_free(&world);
+  return true;
+}
+
+// Rewrites a world file (either format) as a region world under the same
+// name. Region worlds are left alone.
+bool convert_world_to_regions(const char *filename) {
+  if (region_world_exists(filename)) {
+    printf("%s: already a region world\n", filename);
+    return true;
+  }
+  char temp[1024];
+  snprintf(temp, sizeof(temp), "%s.regions", filename);
+  if (region_world_exists(temp)) {
+    printf("%s is in the way\n", temp);
+    return false;
+  }
+
+  Camera2D camera = {0};
+  World world;
+  world_init(&world);
+  read_world_from_file(&camera, &world, filename);
+  WorldSnapshot snapshot = world_snapshot_take(&world, &camera);
+  write_snapshot_to_regions(&snapshot, temp, true, NULL);
+  world_snapshot_release(&snapshot);
+  bool ok = remove(filename) == 0 && rename(temp, filename) == 0;
+  if (ok) {
+    printf("%s: wrote %zu chunks to regions\n", filename, world.count);
+  } else {
+    printf("failed to replace %s\n", filename);
+  }
+  world_free(&world);
+  return ok;
+}
 
 #endif
@@ -0,0 +1,306 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include "chunk.h"
+#include "format.h"
+#include "game.h"
+#include "generate.h"
+#include "region.h"
+#include "world.h"
+#include <dirent.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Streamed loading: a world opens with only the chunks around the saved
+// camera decoded, and world_stream_step, called once per frame, fills in
+// the rest nearest first under a time budget, so the first frame does not
+// wait on the size of the world. Region chunks exist nowhere else until
+// read and are all read in the end; mapped chunks (mapping.h) would be
+// decoded on first use anyway, so they are only decoded ahead of time
+// while the memory budget allows.
+
+// Time world_stream_step may spend per frame, in seconds.
+#define WORLD_STREAM_FRAME_BUDGET 0.002
+
+static inline double world_stream_clock(void) {
+  struct timespec ts;
+  timespec_get(&ts, TIME_UTC);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static inline int64_t world_stream_distance(ChunkCoord a, ChunkCoord b) {
+  int64_t dx = (int64_t)a.x - b.x;
+  int64_t dy = (int64_t)a.y - b.y;
+  return dx * dx + dy * dy;
+}
+
+// Distance from `center` to the nearest chunk of region `region`.
+static inline int64_t world_stream_region_distance(ChunkCoord region, ChunkCoord center) {
+  int min_x = region.x * REGION_SIZE, min_y = region.y * REGION_SIZE;
+  ChunkCoord nearest = {
+      center.x < min_x ? min_x : center.x >= min_x + REGION_SIZE ? min_x + REGION_SIZE - 1 : center.x,
+      center.y < min_y ? min_y : center.y >= min_y + REGION_SIZE ? min_y + REGION_SIZE - 1 : center.y,
+  };
+  return world_stream_distance(nearest, center);
+}
+
+static inline bool world_stream_pending(const World *world) {
+  return world->stream.n_chunks || world->stream.n_regions;
+}
+
+// Restores the heap order of `stream->chunks` below `i`.
+static void world_stream_sift_down(WorldStream *stream, size_t i) {
+  ChunkCoord *heap = stream->chunks;
+  for (;;) {
+    size_t smallest = i;
+    for (size_t child = 2 * i + 1; child <= 2 * i + 2 && child < stream->n_chunks; ++child) {
+      if (world_stream_distance(heap[child], stream->center) < world_stream_distance(heap[smallest], stream->center)) {
+        smallest = child;
+      }
+    }
+    if (smallest == i) {
+      return;
+    }
+    ChunkCoord swap = heap[i];
+    heap[i] = heap[smallest];
+    heap[smallest] = swap;
+    i = smallest;
+  }
+}
+
+// Queues every chunk of `world` still waiting to be decoded from its
+// mapping, nearest to chunk `center` first. Heapifying keeps this linear
+// in the number of chunks, like mapping the world in the first place.
+void world_stream_queue_mapped(World *world, ChunkCoord center) {
+  WorldStream *stream = &world->stream;
+  stream->center = center;
+  stream->chunks = realloc(stream->chunks, (world->count ? world->count : 1) * sizeof(ChunkCoord));
+  stream->n_chunks = 0;
+  for (size_t i = 0; i < world->capacity; ++i) {
+    if (world->slots[i].state == CHUNK_SLOT_MAPPED) {
+      stream->chunks[stream->n_chunks++] = world->slots[i].key;
+    }
+  }
+  for (size_t i = stream->n_chunks / 2; i-- > 0;) {
+    world_stream_sift_down(stream, i);
+  }
+}
+
+// Reads the chunks of pending region `index` into `world` until `deadline`
+// passes, dropping the region once all of them are in. Chunks the world
+// already has (created while the region was pending) are kept. Returns
+// false if the region is corrupt.
+static bool world_stream_read_region(World *world, size_t index, double deadline) {
+  WorldStream *stream = &world->stream;
+  ChunkCoord at = stream->regions[index];
+  RegionFile *region = malloc(sizeof(RegionFile));
+  if (!region_open(region, stream->dir, at.x, at.y, false)) {
+    printf("failed to open region (%d, %d) of %s\n", at.x, at.y, stream->dir);
+    free(region);
+    return false;
+  }
+  int i = index == 0 ? stream->region_next : 0;
+  bool ok = true;
+  // With no deadline the whole region is read at once and decoded in
+  // parallel; chunks already read from it are in the world and are skipped.
+  if (deadline == INFINITY) {
+    ok = region_read_missing(region, world);
+    i = REGION_CHUNKS;
+  }
+  for (; i < REGION_CHUNKS && ok && world_stream_clock() < deadline; ++i) {
+    ChunkCoord coord = {at.x * REGION_SIZE + i % REGION_SIZE, at.y * REGION_SIZE + i / REGION_SIZE};
+    if (!region_has_chunk(region, coord)) {
+      continue;
+    }
+    bool created = false;
+    Chunk *chunk = world_insert_chunk(world, coord.x, coord.y, &created);
+    if (created) {
+      ok = region_read_chunk(region, coord, chunk);
+      chunk_clear_dirty(chunk, CHUNK_DIRTY_SAVE);
+      world_account(world, chunk);
+      if (!ok) {
+        printf("chunk (%d, %d) is corrupt\n", coord.x, coord.y);
+      }
+    }
+  }
+  region_close(region);
+  free(region);
+  if (i == REGION_CHUNKS && ok) {
+    memmove(&stream->regions[index], &stream->regions[index + 1],
+            (stream->n_regions - index - 1) * sizeof(ChunkCoord));
+    stream->n_regions--;
+    stream->region_next = index == 0 ? 0 : stream->region_next;
+  } else if (index == 0) {
+    stream->region_next = i;
+  }
+  return ok;
+}
+
+// Number of chunks in the regions still pending, as listed by their offset
+// tables; none of them is decoded.
+size_t world_stream_pending_chunks(const World *world) {
+  const WorldStream *stream = &world->stream;
+  RegionFile *region = malloc(sizeof(RegionFile));
+  size_t count = 0;
+  for (size_t r = 0; r < stream->n_regions; ++r) {
+    ChunkCoord at = stream->regions[r];
+    if (!region_open(region, stream->dir, at.x, at.y, false)) {
+      continue;
+    }
+    for (int i = r == 0 ? stream->region_next : 0; i < REGION_CHUNKS; ++i) {
+      count += region->table[i].offset != 0;
+    }
+    region_close(region);
+  }
+  free(region);
+  return count;
+}
+
+// Reads every region still pending. Returns false if one is corrupt.
+bool world_stream_finish(World *world) {
+  while (world->stream.n_regions) {
+    if (!world_stream_read_region(world, 0, INFINITY)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Loads the chunks around `position` that are still pending, since the
+// player can reach them (and world_generate_around must not mistake region
+// chunks for missing ones), then spends what is left of `budget` seconds on
+// the rest, nearest first. Returns whether anything is still pending.
+bool world_stream_step(World *world, Vector2 position, double budget) {
+  WorldStream *stream = &world->stream;
+  if (!world_stream_pending(world)) {
+    return false;
+  }
+  double deadline = world_stream_clock() + budget;
+  int center_x = world_chunk_x(position.x);
+  int center_y = world_chunk_y(position.y);
+  for (size_t i = 0; i < stream->n_regions;) {
+    ChunkCoord region = stream->regions[i];
+    if (region.x >= region_coord(center_x - WORLD_LOAD_RADIUS) &&
+        region.x <= region_coord(center_x + WORLD_LOAD_RADIUS) &&
+        region.y >= region_coord(center_y - WORLD_LOAD_RADIUS_Y) &&
+        region.y <= region_coord(center_y + WORLD_LOAD_RADIUS_Y)) {
+      if (!world_stream_read_region(world, i, INFINITY)) {
+        exit(1);
+      }
+    } else {
+      ++i;
+    }
+  }
+  for (int cx = center_x - WORLD_LOAD_RADIUS; cx <= center_x + WORLD_LOAD_RADIUS; ++cx) {
+    for (int cy = center_y - WORLD_LOAD_RADIUS_Y; cy <= center_y + WORLD_LOAD_RADIUS_Y; ++cy) {
+      world_find_chunk(world, cx, cy);
+    }
+  }
+
+  while (stream->n_regions && world_stream_clock() < deadline) {
+    if (!world_stream_read_region(world, 0, deadline)) {
+      exit(1);
+    }
+  }
+  const ChunkCache *cache = &world->cache;
+  while (stream->n_chunks && cache->resident_bytes < cache->budget && world_stream_clock() < deadline) {
+    ChunkCoord coord = stream->chunks[0];
+    stream->chunks[0] = stream->chunks[--stream->n_chunks];
+    world_stream_sift_down(stream, 0);
+    ChunkSlot *slot = &world->slots[world_probe(world, coord)];
+    if (slot->state == CHUNK_SLOT_MAPPED) {
+      world_touch(world, slot);
+    }
+  }
+  // Whatever does not fit stays mapped, to be decoded when first used.
+  if (cache->resident_bytes >= cache->budget) {
+    stream->n_chunks = 0;
+  }
+  return world_stream_pending(world);
+}
+
+// Takes over the generator and seed a world file records. Files from before
+// version 5 record neither and leave the world's own. Returns false if the
+// file was made by a generator this build does not have.
+static bool world_restore_generator(World *world, const WorldFileHeader *header) {
+  if (header->generator == 0) {
+    return true;
+  }
+  if (!generator_is_known(header->generator)) {
+    printf("world was generated by generator %u, this build has %d to %d\n", header->generator,
+           GENERATOR_MIN_VERSION, GENERATOR_VERSION);
+    return false;
+  }
+  world->seed = header->seed;
+  world->generator = header->generator;
+  return true;
+}
+
+// Reads the level header of the region world in `dir` and queues its
+// regions for world_stream_step, nearest to the saved camera first, without
+// reading any of them. Returns false if it is not a readable region world.
+bool stream_world_from_regions(Camera2D *camera, World *world, const char *dir) {
+  char path[1024];
+  snprintf(path, sizeof(path), "%s/level", dir);
+  uint8_t level[WORLD_HEADER_SIZE];
+  FILE *file = fopen(path, "rb");
+  size_t size = file ? fread(level, 1, sizeof(level), file) : 0;
+  if (file) {
+    fclose(file);
+  }
+  WorldFileHeader header;
+  if (!world_format_parse_header(level, size, &header)) {
+    return false;
+  }
+  camera->offset = header.camera_offset;
+  camera->target = header.camera_target;
+  world_clear(world);
+  if (!world_restore_generator(world, &header)) {
+    return false;
+  }
+
+  DIR *entries = opendir(dir);
+  if (!entries) {
+    return false;
+  }
+  WorldStream *stream = &world->stream;
+  stream->center = (ChunkCoord){world_chunk_x(camera->target.x), world_chunk_y(camera->target.y)};
+  stream->dir = strdup(dir);
+  size_t capacity = 0;
+  struct dirent *entry;
+  while ((entry = readdir(entries)) != NULL) {
+    int rx, ry;
+    int length = -1;
+    sscanf(entry->d_name, "r.%d.%d.region%n", &rx, &ry, &length);
+    if (length < 0 || entry->d_name[length] != '\0') {
+      continue;
+    }
+    if (stream->n_regions == capacity) {
+      capacity = capacity ? capacity * 2 : 16;
+      stream->regions = realloc(stream->regions, capacity * sizeof(ChunkCoord));
+    }
+    // Insertion sort: worlds have few regions.
+    ChunkCoord region = {rx, ry};
+    int64_t distance = world_stream_region_distance(region, stream->center);
+    size_t i = stream->n_regions++;
+    for (; i > 0 && world_stream_region_distance(stream->regions[i - 1], stream->center) > distance; --i) {
+      stream->regions[i] = stream->regions[i - 1];
+    }
+    stream->regions[i] = region;
+  }
+  closedir(entries);
+  return true;
+}
+
+// Replaces the contents of `world` with every chunk of the region world in
+// `dir`.
+bool read_world_from_regions(Camera2D *camera, World *world, const char *dir) {
+  return stream_world_from_regions(camera, world, dir) && world_stream_finish(world);
+}
+
+#endif
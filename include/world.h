@@ -0,0 +1,619 @@
+#ifndef WORLD_H
+#define WORLD_H
+
+#include "chunk.h"
+#include "format.h"
+#include "game.h"
+#include "mapping.h"
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define WORLD_INITIAL_CAPACITY 64
+
+// Floor division, so that negative world coordinates land in the chunk to
+// their left instead of chunk 0.
+static inline int floor_div(int a, int b) { return a / b - (a % b != 0 && (a < 0) != (b < 0)); }
+
+static inline int world_chunk_x(float x) { return (int)floorf(x / CHUNK_WIDTH); }
+
+static inline int world_chunk_y(float y) { return (int)floorf(y / CHUNK_HEIGHT); }
+
+// World pixels covered by chunk (cx, cy).
+static inline Rectangle world_chunk_bounds(int cx, int cy) {
+  return (Rectangle){
+      .x = (float)cx * CHUNK_WIDTH,
+      .y = (float)cy * CHUNK_HEIGHT,
+      .width = CHUNK_WIDTH,
+      .height = CHUNK_HEIGHT,
+  };
+}
+
+static inline bool chunk_coord_equal(ChunkCoord a, ChunkCoord b) { return a.x == b.x && a.y == b.y; }
+
+static inline size_t world_hash(ChunkCoord key) {
+  uint32_t h = (uint32_t)key.x * 0x9e3779b1u ^ (uint32_t)key.y;
+  h ^= h >> 16;
+  h *= 0x7feb352d;
+  h ^= h >> 15;
+  h *= 0x846ca68b;
+  h ^= h >> 16;
+  return h;
+}
+
+void world_init(World *world) {
+  *world = (World){0};
+  world->capacity = WORLD_INITIAL_CAPACITY;
+  world->slots = calloc(world->capacity, sizeof(ChunkSlot));
+  world->cache.budget = WORLD_MEMORY_BUDGET;
+  world->generator = GENERATOR_VERSION;
+}
+
+// Brings resident_bytes up to date with `chunk`, once it is resident and
+// whenever its blocks or mesh may have changed size.
+static inline void world_account(World *world, Chunk *chunk) {
+  size_t usage = chunk_memory_usage(chunk);
+  world->cache.resident_bytes = world->cache.resident_bytes - chunk->accounted + usage;
+  chunk->accounted = usage;
+}
+
+// world_account for `count` chunks, e.g. after decoding them in bulk.
+static void world_account_chunks(World *world, Chunk **chunks, size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    world_account(world, chunks[i]);
+  }
+}
+
+static void world_destroy_chunk(World *world, Chunk *chunk) {
+  world->cache.resident_bytes -= chunk->accounted;
+  chunk_free(chunk);
+  free(chunk);
+}
+
+// Index of the slot holding `key`, or of the empty slot where it would go.
+static inline size_t world_probe(const World *world, ChunkCoord key) {
+  size_t mask = world->capacity - 1;
+  size_t i = world_hash(key) & mask;
+  while (world->slots[i].state != CHUNK_SLOT_EMPTY && !chunk_coord_equal(world->slots[i].key, key)) {
+    i = (i + 1) & mask;
+  }
+  return i;
+}
+
+static inline void world_lru_unlink(ChunkCache *cache, Chunk *chunk) {
+  if (chunk->lru_prev) {
+    chunk->lru_prev->lru_next = chunk->lru_next;
+  } else {
+    cache->lru_head = chunk->lru_next;
+  }
+  if (chunk->lru_next) {
+    chunk->lru_next->lru_prev = chunk->lru_prev;
+  } else {
+    cache->lru_tail = chunk->lru_prev;
+  }
+  chunk->lru_prev = chunk->lru_next = NULL;
+}
+
+static inline void world_lru_push_front(ChunkCache *cache, Chunk *chunk) {
+  chunk->lru_prev = NULL;
+  chunk->lru_next = cache->lru_head;
+  if (cache->lru_head) {
+    cache->lru_head->lru_prev = chunk;
+  } else {
+    cache->lru_tail = chunk;
+  }
+  cache->lru_head = chunk;
+}
+
+// On-disk layout of a swapped-out chunk: fixed size, so a chunk that is
+// evicted again overwrites its previous record.
+typedef struct {
+  Rectangle bounds;
+  BlockId blocks[CHUNK_CELLS];
+} ChunkSwapRecord;
+
+// A chunk reloaded from swap or the world file comes back with only the
+// dirty state its slot remembers: unsaved changes, and a mesh to build.
+static void world_reset_dirty(const ChunkSlot *slot, Chunk *chunk) {
+  for (int i = 0; i < CHUNK_DIRTY_CONSUMERS; ++i) {
+    chunk_clear_dirty(chunk, i);
+  }
+  chunk->dirty_rows[CHUNK_DIRTY_RENDER] = CHUNK_ALL_ROWS;
+  if (slot->save_dirty) {
+    chunk->dirty_rows[CHUNK_DIRTY_SAVE] = CHUNK_ALL_ROWS;
+  }
+}
+
+// Decodes the swap record of `slot` into `chunk`.
+static void world_swap_read(const World *world, const ChunkSlot *slot, Chunk *chunk) {
+  ChunkSwapRecord record;
+  fseek(world->cache.swap, slot->swap_offset, SEEK_SET);
+  if (fread(&record, sizeof(record), 1, world->cache.swap) != 1) {
+    printf("failed to read chunk (%d, %d) back from swap\n", slot->key.x, slot->key.y);
+    exit(1);
+  }
+  chunk->bounds = record.bounds;
+  chunk_load_cells(chunk, record.blocks);
+  world_reset_dirty(slot, chunk);
+}
+
+// Decodes the chunk of a mapped `slot` from the world file into `chunk`.
+static void world_map_read(const World *world, const ChunkSlot *slot, Chunk *chunk) {
+  const WorldMapping *mapping = world->mapping;
+  WorldFileEntry entry;
+  world_format_mapped_entry(mapping, slot->entry, &entry);
+  if (!world_format_decode_chunk(mapping->data, &entry, chunk)) {
+    printf("chunk (%d, %d) is corrupt\n", slot->key.x, slot->key.y);
+    exit(1);
+  }
+  world_reset_dirty(slot, chunk);
+}
+
+static void world_swap_out(World *world, ChunkSlot *slot) {
+  ChunkCache *cache = &world->cache;
+  if (!cache->swap) {
+    cache->swap = tmpfile();
+    if (!cache->swap) {
+      printf("failed to create chunk swap file\n");
+      exit(1);
+    }
+  }
+
+  // A chunk unchanged since its last eviction still matches its record, and
+  // one never changed since it was decoded still matches the world file.
+  Chunk *chunk = slot->chunk;
+  bool mapped = slot->swap_offset < 0 && slot->entry != CHUNK_NO_ENTRY && !chunk_is_dirty(chunk, CHUNK_DIRTY_SWAP);
+  if (!mapped && (slot->swap_offset < 0 || chunk_is_dirty(chunk, CHUNK_DIRTY_SWAP))) {
+    if (slot->swap_offset < 0) {
+      slot->swap_offset = cache->swap_end;
+      cache->swap_end += sizeof(ChunkSwapRecord);
+    }
+    ChunkSwapRecord record = {.bounds = chunk->bounds};
+    chunk_store_cells(chunk, record.blocks);
+    fseek(cache->swap, slot->swap_offset, SEEK_SET);
+    fwrite(&record, sizeof(record), 1, cache->swap);
+  }
+  slot->save_dirty = chunk_is_dirty(chunk, CHUNK_DIRTY_SAVE);
+
+  world_lru_unlink(cache, chunk);
+  world_destroy_chunk(world, chunk);
+  slot->chunk = NULL;
+  slot->state = mapped ? CHUNK_SLOT_MAPPED : CHUNK_SLOT_SWAPPED;
+  world->resident--;
+  cache->evictions++;
+}
+
+static void world_swap_in(World *world, ChunkSlot *slot) {
+  Chunk *chunk = calloc(1, sizeof(Chunk));
+  if (slot->state == CHUNK_SLOT_MAPPED) {
+    world_map_read(world, slot, chunk);
+  } else {
+    world_swap_read(world, slot, chunk);
+  }
+  chunk->coord = slot->key;
+  slot->chunk = chunk;
+  slot->state = CHUNK_SLOT_RESIDENT;
+  world->resident++;
+  world_lru_push_front(&world->cache, chunk);
+  world_account(world, chunk);
+}
+
+// Marks the chunk in `slot` as just used, reloading it from swap if it had
+// been evicted, or decoding it if it has not been touched since the world
+// was mapped.
+static inline Chunk *world_touch(World *world, ChunkSlot *slot) {
+  if (slot->state != CHUNK_SLOT_RESIDENT) {
+    world->cache.misses++;
+    world_swap_in(world, slot);
+  } else {
+    world->cache.hits++;
+    if (world->cache.lru_head != slot->chunk) {
+      world_lru_unlink(&world->cache, slot->chunk);
+      world_lru_push_front(&world->cache, slot->chunk);
+    }
+  }
+  return slot->chunk;
+}
+
+// Returns the chunk at (cx, cy), transparently reloading it if it was
+// swapped out, or NULL if the world has no such chunk.
+static inline Chunk *world_find_chunk(World *world, int cx, int cy) {
+  ChunkSlot *slot = &world->slots[world_probe(world, (ChunkCoord){cx, cy})];
+  if (slot->state == CHUNK_SLOT_EMPTY) {
+    return NULL;
+  }
+  return world_touch(world, slot);
+}
+
+// Whether the world has chunk (cx, cy), without reloading it.
+static inline bool world_has_chunk(const World *world, int cx, int cy) {
+  return world->slots[world_probe(world, (ChunkCoord){cx, cy})].state != CHUNK_SLOT_EMPTY;
+}
+
+// Integer block coordinates: block (x, y) covers world pixels starting at
+// (x * BLOCK_SIZE_X, y * BLOCK_SIZE_Y). The chunk/local split below compiles
+// to a shift and a mask when the grid size is a power of two.
+#define IS_POWER_OF_TWO(n) (((n) & ((n) - 1)) == 0)
+
+static inline int world_block_chunk_x(int x) {
+  return IS_POWER_OF_TWO(GRID_X) ? x >> __builtin_ctz(GRID_X) : floor_div(x, GRID_X);
+}
+
+static inline int world_block_chunk_y(int y) {
+  return IS_POWER_OF_TWO(GRID_Y) ? y >> __builtin_ctz(GRID_Y) : floor_div(y, GRID_Y);
+}
+
+static inline int world_block_local_x(int x) {
+  return IS_POWER_OF_TWO(GRID_X) ? x & (GRID_X - 1) : x - floor_div(x, GRID_X) * GRID_X;
+}
+
+static inline int world_block_local_y(int y) {
+  return IS_POWER_OF_TWO(GRID_Y) ? y & (GRID_Y - 1) : y - floor_div(y, GRID_Y) * GRID_Y;
+}
+
+// Block coordinates of the block under world pixel `position`.
+static inline int world_block_x(float x) { return (int)floorf(x / BLOCK_SIZE_X); }
+
+static inline int world_block_y(float y) { return (int)floorf(y / BLOCK_SIZE_Y); }
+
+static inline Rectangle world_block_rect(int x, int y) {
+  return (Rectangle){
+      .x = (float)x * BLOCK_SIZE_X,
+      .y = (float)y * BLOCK_SIZE_Y,
+      .width = BLOCK_SIZE_X,
+      .height = BLOCK_SIZE_Y,
+  };
+}
+
+// Air where the world has no chunk.
+static inline BlockType world_get_block(World *world, int x, int y) {
+  Chunk *chunk = world_find_chunk(world, world_block_chunk_x(x), world_block_chunk_y(y));
+  if (!chunk) {
+    return BLOCK_TYPE_AIR;
+  }
+  return chunk_get(chunk, world_block_local_x(x), world_block_local_y(y));
+}
+
+// Returns false, changing nothing, where the world has no chunk.
+static inline bool world_set_block(World *world, int x, int y, BlockType type) {
+  Chunk *chunk = world_find_chunk(world, world_block_chunk_x(x), world_block_chunk_y(y));
+  if (!chunk) {
+    return false;
+  }
+  chunk_set(chunk, world_block_local_x(x), world_block_local_y(y), type);
+  world_account(world, chunk);
+  return true;
+}
+
+// Finds the topmost solid block in block column `x`, searching down from
+// block row `from_y` through at most `max_chunks` chunks. Costs one
+// heightmap lookup per chunk; missing chunks count as air.
+bool world_column_top(World *world, int x, int from_y, int max_chunks, int *top_y) {
+  int cx = world_block_chunk_x(x);
+  int local_x = world_block_local_x(x);
+  int cy = world_block_chunk_y(from_y);
+  int local_y = world_block_local_y(from_y);
+  for (int i = 0; i < max_chunks; ++i, ++cy, local_y = 0) {
+    Chunk *chunk = world_find_chunk(world, cx, cy);
+    if (!chunk) {
+      continue;
+    }
+    int y = chunk_column_top(chunk, local_x);
+    // The cached top may sit above the search start; walk down from there.
+    while (y < local_y || (y < GRID_Y && !block_is_solid(chunk_get(chunk, local_x, y)))) {
+      y++;
+    }
+    if (y < GRID_Y) {
+      *top_y = cy * GRID_Y + y;
+      return true;
+    }
+  }
+  return false;
+}
+
+static void world_rehash(World *world, size_t capacity) {
+  ChunkSlot *old = world->slots;
+  size_t old_capacity = world->capacity;
+  world->capacity = capacity;
+  world->slots = calloc(world->capacity, sizeof(ChunkSlot));
+  for (size_t i = 0; i < old_capacity; ++i) {
+    if (old[i].state != CHUNK_SLOT_EMPTY) {
+      world->slots[world_probe(world, old[i].key)] = old[i];
+    }
+  }
+  free(old);
+}
+
+// Makes room for `n` more chunks with at most one rehash.
+void world_reserve(World *world, size_t n) {
+  size_t capacity = world->capacity;
+  while ((world->count + n) * 4 > capacity * 3) {
+    capacity *= 2;
+  }
+  if (capacity != world->capacity) {
+    world_rehash(world, capacity);
+  }
+}
+
+// Returns the chunk at (cx, cy), allocating an empty (all air) one if there
+// is none yet. `created` is set when a new chunk was added.
+Chunk *world_insert_chunk(World *world, int cx, int cy, bool *created) {
+  world_reserve(world, 1);
+  ChunkCoord key = {cx, cy};
+  ChunkSlot *slot = &world->slots[world_probe(world, key)];
+  if (created) {
+    *created = slot->state == CHUNK_SLOT_EMPTY;
+  }
+  if (slot->state != CHUNK_SLOT_EMPTY) {
+    return world_touch(world, slot);
+  }
+
+  Chunk *chunk = calloc(1, sizeof(Chunk));
+  chunk_init(chunk, world_chunk_bounds(cx, cy));
+  chunk->coord = key;
+  *slot = (ChunkSlot){
+      .key = key,
+      .state = CHUNK_SLOT_RESIDENT,
+      .entry = CHUNK_NO_ENTRY,
+      .swap_offset = -1,
+      .chunk = chunk,
+  };
+  world->count++;
+  world->resident++;
+  world_lru_push_front(&world->cache, chunk);
+  world_account(world, chunk);
+  return chunk;
+}
+
+// Registers chunk (cx, cy) as stored at directory entry `entry` of the
+// world's mapping, without decoding it. Replaces any chunk already there.
+void world_insert_mapped(World *world, int cx, int cy, uint32_t entry) {
+  world_reserve(world, 1);
+  ChunkCoord key = {cx, cy};
+  ChunkSlot *slot = &world->slots[world_probe(world, key)];
+  if (slot->state == CHUNK_SLOT_RESIDENT) {
+    world_lru_unlink(&world->cache, slot->chunk);
+    world_destroy_chunk(world, slot->chunk);
+    world->resident--;
+  } else if (slot->state == CHUNK_SLOT_EMPTY) {
+    world->count++;
+  }
+  *slot = (ChunkSlot){
+      .key = key,
+      .state = CHUNK_SLOT_MAPPED,
+      .entry = entry,
+      .swap_offset = -1,
+  };
+}
+
+// Removes the chunk at (cx, cy). Uses backward-shift deletion so lookups
+// never need tombstones.
+bool world_remove_chunk(World *world, int cx, int cy) {
+  size_t mask = world->capacity - 1;
+  size_t hole = world_probe(world, (ChunkCoord){cx, cy});
+  ChunkSlot *slot = &world->slots[hole];
+  if (slot->state == CHUNK_SLOT_EMPTY) {
+    return false;
+  }
+  if (slot->state == CHUNK_SLOT_RESIDENT) {
+    world_lru_unlink(&world->cache, slot->chunk);
+    world_destroy_chunk(world, slot->chunk);
+    world->resident--;
+  }
+  *slot = (ChunkSlot){0};
+  world->count--;
+
+  for (size_t i = (hole + 1) & mask; world->slots[i].state != CHUNK_SLOT_EMPTY; i = (i + 1) & mask) {
+    size_t home = world_hash(world->slots[i].key) & mask;
+    // Move the entry back if the hole lies between its home slot and i.
+    if (((i - home) & mask) >= ((i - hole) & mask)) {
+      world->slots[hole] = world->slots[i];
+      world->slots[i] = (ChunkSlot){0};
+      hole = i;
+    }
+  }
+  return true;
+}
+
+// Removes every chunk and drops the mapping and any loading left to stream,
+// but keeps the table and swap file allocated.
+void world_clear(World *world) {
+  for (size_t i = 0; i < world->capacity; ++i) {
+    if (world->slots[i].state == CHUNK_SLOT_RESIDENT) {
+      world_destroy_chunk(world, world->slots[i].chunk);
+    }
+    world->slots[i] = (ChunkSlot){0};
+  }
+  world->count = 0;
+  world->resident = 0;
+  world->cache.lru_head = world->cache.lru_tail = NULL;
+  world->cache.swap_end = 0;
+  world_mapping_release(world->mapping);
+  world->mapping = NULL;
+  free(world->file);
+  world->file = NULL;
+  world->file_base = world->file_end = 0;
+  free(world->stream.chunks);
+  free(world->stream.regions);
+  free(world->stream.dir);
+  world->stream = (WorldStream){0};
+}
+
+void world_free(World *world) {
+  world_clear(world);
+  if (world->cache.swap) {
+    fclose(world->cache.swap);
+  }
+  free(world->slots);
+  *world = (World){0};
+}
+
+// Swaps least recently used chunks out to disk until resident chunks fit in
+// the memory budget. Chunks inside the load band around `center` are never
+// evicted, so the budget may be exceeded if the band alone does not fit.
+void world_trim(World *world, Vector2 center) {
+  ChunkCache *cache = &world->cache;
+  if (cache->resident_bytes <= cache->budget) {
+    return;
+  }
+  int center_x = world_chunk_x(center.x);
+  int center_y = world_chunk_y(center.y);
+  Chunk *chunk = cache->lru_tail;
+  while (chunk && cache->resident_bytes > cache->budget) {
+    Chunk *prev = chunk->lru_prev;
+    if (abs(chunk->coord.x - center_x) > WORLD_LOAD_RADIUS ||
+        abs(chunk->coord.y - center_y) > WORLD_LOAD_RADIUS_Y) {
+      world_swap_out(world, &world->slots[world_probe(world, chunk->coord)]);
+    }
+    chunk = prev;
+  }
+}
+
+// Whether the chunk in `slot`, resident or swapped out, has changes not yet
+// saved. Mapped chunks never do.
+static inline bool world_slot_is_dirty(const ChunkSlot *slot) {
+  return (slot->state == CHUNK_SLOT_RESIDENT && chunk_is_dirty(slot->chunk, CHUNK_DIRTY_SAVE)) ||
+         (slot->state == CHUNK_SLOT_SWAPPED && slot->save_dirty);
+}
+
+bool world_is_dirty(const World *world) {
+  for (size_t i = 0; i < world->capacity; ++i) {
+    if (world_slot_is_dirty(&world->slots[i])) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Records that every chunk has been written out.
+void world_clear_save_dirty(World *world) {
+  for (size_t i = 0; i < world->capacity; ++i) {
+    ChunkSlot *slot = &world->slots[i];
+    if (slot->state == CHUNK_SLOT_RESIDENT) {
+      chunk_clear_dirty(slot->chunk, CHUNK_DIRTY_SAVE);
+    }
+    slot->save_dirty = false;
+  }
+}
+
+static int world_compare_slots(const void *a, const void *b) {
+  ChunkCoord ka = (*(const ChunkSlot *const *)a)->key;
+  ChunkCoord kb = (*(const ChunkSlot *const *)b)->key;
+  if (ka.x != kb.x) {
+    return (ka.x > kb.x) - (ka.x < kb.x);
+  }
+  return (ka.y > kb.y) - (ka.y < kb.y);
+}
+
+// Fills `out` (world->count entries) with the occupied slots, resident,
+// swapped or mapped, ordered by chunk x then y so that saves are deterministic.
+void world_sorted_slots(const World *world, const ChunkSlot **out) {
+  size_t n = 0;
+  for (size_t i = 0; i < world->capacity; ++i) {
+    if (world->slots[i].state != CHUNK_SLOT_EMPTY) {
+      out[n++] = &world->slots[i];
+    }
+  }
+  qsort(out, n, sizeof(*out), world_compare_slots);
+}
+
+// O(number of chunks): resident chunks share their block data with the
+// snapshot; swapped-out chunks are decoded into data the snapshot owns;
+// mapped chunks stay encoded, the snapshot keeping the mapping alive.
+// Taking a snapshot counts as saving for the dirty-tracking of `world`.
+// With `only_dirty`, the snapshot holds just the chunks with unsaved changes.
+static WorldSnapshot world_snapshot_collect(World *world, const Camera2D *camera, bool only_dirty) {
+  const ChunkSlot **slots = malloc(world->count * sizeof(*slots));
+  world_sorted_slots(world, slots);
+  size_t count = world->count;
+  if (only_dirty) {
+    count = 0;
+    for (size_t i = 0; i < world->count; ++i) {
+      if (world_slot_is_dirty(slots[i])) {
+        slots[count++] = slots[i];
+      }
+    }
+  }
+  WorldSnapshot snapshot = {
+      .camera = *camera,
+      .chunks = malloc(count * sizeof(Chunk)),
+      .count = count,
+      .seed = world->seed,
+      .generator = world->generator,
+  };
+  if (world->mapping) {
+    snapshot.mapping = world_mapping_retain(world->mapping);
+    snapshot.entries = malloc(count * sizeof(uint32_t));
+  }
+  for (size_t i = 0; i < count; ++i) {
+    Chunk *copy = &snapshot.chunks[i];
+    if (snapshot.entries) {
+      snapshot.entries[i] = slots[i]->state == CHUNK_SLOT_MAPPED ? slots[i]->entry : CHUNK_NO_ENTRY;
+    }
+    if (slots[i]->state == CHUNK_SLOT_RESIDENT) {
+      *copy = *slots[i]->chunk;
+      chunk_data_retain(copy->data);
+    } else if (slots[i]->state == CHUNK_SLOT_MAPPED) {
+      WorldFileEntry entry;
+      world_format_mapped_entry(world->mapping, slots[i]->entry, &entry);
+      *copy = (Chunk){.bounds = entry.bounds};
+    } else {
+      *copy = (Chunk){0};
+      world_swap_read(world, slots[i], copy);
+    }
+    copy->coord = slots[i]->key;
+    copy->mesh = NULL;
+    copy->lru_prev = copy->lru_next = NULL;
+  }
+  free(slots);
+  world_clear_save_dirty(world);
+  return snapshot;
+}
+
+WorldSnapshot world_snapshot_take(World *world, const Camera2D *camera) {
+  return world_snapshot_collect(world, camera, false);
+}
+
+// Only the chunks changed since the last save, for journaled saves.
+WorldSnapshot world_snapshot_take_dirty(World *world, const Camera2D *camera) {
+  return world_snapshot_collect(world, camera, true);
+}
+
+// Safe to call from any thread.
+void world_snapshot_release(WorldSnapshot *snapshot) {
+  for (size_t i = 0; i < snapshot->count; ++i) {
+    chunk_data_release(snapshot->chunks[i].data);
+  }
+  free(snapshot->chunks);
+  free(snapshot->entries);
+  world_mapping_release(snapshot->mapping);
+  *snapshot = (WorldSnapshot){0};
+}
+
+// Logs how much memory the world's chunks take, next to what the old
+// BlockType[BLOCK_SIZE_Y][BLOCK_SIZE_X] layout used to cost, and how the
+// chunk cache has been doing.
+void world_footprint_report(const World *world) {
+  size_t legacy = sizeof(Rectangle) + sizeof(BlockType[BLOCK_SIZE_Y][BLOCK_SIZE_X]);
+  size_t total = world->capacity * sizeof(ChunkSlot) + world->cache.resident_bytes;
+  size_t uniform = 0;
+  for (const Chunk *chunk = world->cache.lru_head; chunk; chunk = chunk->lru_next) {
+    uniform += chunk_is_uniform(chunk);
+  }
+  size_t n_chunks = world->resident;
+  const ChunkCache *cache = &world->cache;
+  TraceLog(LOG_INFO, "CHUNK: %zu chunks resident (%zu uniform), %zu bytes total, %zu bytes per chunk on average",
+           n_chunks, uniform, total, n_chunks ? total / n_chunks : 0);
+  TraceLog(LOG_INFO, "CHUNK: the legacy layout would use %zu bytes (%.1fx more)",
+           n_chunks * legacy, total ? (double)(n_chunks * legacy) / total : 0.0);
+  size_t mapped = 0;
+  for (size_t i = 0; i < world->capacity; ++i) {
+    mapped += world->slots[i].state == CHUNK_SLOT_MAPPED;
+  }
+  TraceLog(LOG_INFO, "CHUNK: %zu not decoded yet, %zu swapped out, budget %zu bytes, %zu hits, %zu misses, %zu evictions",
+           mapped, world->count - world->resident - mapped, cache->budget, cache->hits, cache->misses, cache->evictions);
+}
+
+#endif
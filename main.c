@@ -1,65 +1,113 @@
+#include "bench.h"
+#include "block.h"
+#include "catalog.h"
+#include "chunk.h"
 #include "dirent.h"
 #include "game.h"
+#include "generate.h"
+#include "generator.h"
 #include "raylib.h"
 #include "raymath.h"
+#include "saver.h"
 #include "serialize.h"
+#include "stream.h"
+#include "world.h"
 #include "stdlib.h"
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 
 #define fn static inline
 
-fn bool select_filename(char **filename) {
-  DIR *dir = opendir("./worlds/");
-  struct dirent *entry;
-  *filename = NULL;
-  char *files[16];
-  int index = 0;
-  while (index < 16 && (entry = readdir(dir)) != NULL) {
-    if (strstr(entry->d_name, ".data") != NULL) {
-      files[index] = entry->d_name;
-      index++;
+// Thumbnail rows are drawn as runs of one colour, like chunk meshes.
+fn void draw_catalog_entry(const CatalogEntry *entry, int number, Vector2 position) {
+  const int SCALE = 2;
+  for (int y = 0; y < CATALOG_THUMB_HEIGHT; ++y) {
+    for (int x = 0; x < CATALOG_THUMB_WIDTH;) {
+      int start = x;
+      BlockId block = entry->thumbnail[y][x];
+      while (x < CATALOG_THUMB_WIDTH && entry->thumbnail[y][x] == block) {
+        x++;
+      }
+      DrawRectangle(position.x + start * SCALE, position.y + y * SCALE, (x - start) * SCALE, SCALE,
+                    block_color((BlockType)block));
     }
   }
 
-  if (index == 0) {
+  char buffer[1024];
+  snprintf(buffer, sizeof(buffer), "#%d : %s", number, entry->name);
+  DrawText(buffer, position.x + CATALOG_THUMB_WIDTH * SCALE + 16, position.y, 24, WHITE);
+  char played[64] = "never played";
+  if (entry->last_played) {
+    time_t played_at = (time_t)entry->last_played;
+    strftime(played, sizeof(played), "played %Y-%m-%d %H:%M", localtime(&played_at));
+  }
+  snprintf(buffer, sizeof(buffer), "%.1f KiB, %u chunks, %s", entry->size / 1024.0, entry->chunk_count, played);
+  DrawText(buffer, position.x + CATALOG_THUMB_WIDTH * SCALE + 16, position.y + 28, 16, GRAY);
+}
+
+// World selection menu, drawn from the world catalog (catalog.h) a page at
+// a time.
+fn bool select_filename(char **filename) {
+  const int PAGE_SIZE = 8;
+  WorldCatalog catalog;
+  catalog_open(&catalog, "worlds");
+  *filename = NULL;
+  if (catalog.count == 0) {
+    catalog_free(&catalog);
     return false;
   }
 
+  bool create = false;
+  int page = 0;
+  int pages = (catalog.count + PAGE_SIZE - 1) / PAGE_SIZE;
   while (!WindowShouldClose()) {
     BeginDrawing();
     ClearBackground(BLACK);
 
-    Vector2 begin = {250, 150};
+    Vector2 begin = {128, 150};
 
     DrawText("press the number to load the file.\npress '-' for a new world.",
-             128, 100, 24, WHITE);
-    for (int i = 0; i < index; ++i) {
-      char buffer[1024];
-      snprintf(buffer, 1024, "#%d : %s", i + 1, files[i]);
-      DrawText(buffer, begin.x, begin.y + (i * 24), 24, WHITE);
+             128, 60, 24, WHITE);
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), "page %d of %d, [left/right] to turn", page + 1, pages);
+    DrawText(buffer, 128, 116, 16, GRAY);
+    int first = page * PAGE_SIZE;
+    for (int i = 0; i < PAGE_SIZE && first + i < (int)catalog.count; ++i) {
+      draw_catalog_entry(&catalog.entries[first + i], i + 1,
+                         (Vector2){begin.x, begin.y + i * 54});
     }
 
     if (IsKeyPressed(KEY_MINUS)) {
-      *filename = nullptr;
-      return true;
+      create = true;
+      EndDrawing();
+      break;
+    }
+    if (IsKeyPressed(KEY_RIGHT) && page + 1 < pages) {
+      page++;
+    } else if (IsKeyPressed(KEY_LEFT) && page > 0) {
+      page--;
     }
 
-    for (int key = KEY_ONE; key < KEY_NINE && (key - KEY_ONE) < index; key++) {
+    for (int key = KEY_ONE; key < KEY_ONE + PAGE_SIZE && first + (key - KEY_ONE) < (int)catalog.count; key++) {
       if (IsKeyPressed(key)) {
-        *filename = strdup(files[key - KEY_ONE]);
-        EndDrawing();
-        goto found_file;
+        char path[1024];
+        catalog_path(path, sizeof(path), catalog.dir, catalog.entries[first + key - KEY_ONE].name);
+        *filename = strdup(path);
+        catalog_mark_played(&catalog, first + key - KEY_ONE);
+        break;
       }
     }
     EndDrawing();
+    if (*filename) {
+      break;
+    }
   }
-found_file:
-  closedir(dir);
-  return false;
+  catalog_free(&catalog);
+  return create;
 }
 
-fn void save_new_world(Camera2D *camera, Chunk *chunks,
+fn void save_new_world(SaveService *saver, Camera2D *camera, World *world,
                                   char **filename) {
   char buffer[1024] = {0};
   int index = 0;
@@ -78,7 +126,7 @@ fn void save_new_world(Camera2D *camera, Chunk *chunks,
         free(*filename);
       }
       *filename = strdup(buffer);
-      write_world_to_file(camera, chunks, buffer);
+      save_service_save(saver, camera, world, buffer);
       return;
     } else if (IsKeyPressed(KEY_BACKSPACE) && index >= 0) {
       buffer[index--] = '\0';
@@ -95,75 +143,134 @@ fn void save_new_world(Camera2D *camera, Chunk *chunks,
   }
 }
 
-fn void chunk_generate(Chunk *chunk, float x_offset) {
-  chunk->bounds = (Rectangle){
-      .x = x_offset,
-      .y = 0,
-      .width = BLOCK_SIZE_X * GRID_X,
-      .height = BLOCK_SIZE_Y * GRID_Y,
-  };
-  const int start_depth = 6;
-  for (int y = 0; y < BLOCK_SIZE_Y; ++y) {
-    for (int x = 0; x < BLOCK_SIZE_Y; ++x) {
-      if (y < start_depth) {
-        chunk->blocks[y][x] = BLOCK_TYPE_AIR;
-        continue;
-      }
+// Shows how far a background save has got, in screen space.
+fn void draw_save_progress(SaveService *saver) {
+  float progress = 0.0f;
+  if (save_service_progress(saver, &progress)) {
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), "saving... %d%%", (int)(progress * 100));
+    DrawText(buffer, 10, 10, 20, WHITE);
+  }
+}
 
-      if (y - start_depth == 0) {
-        chunk->blocks[y][x] = BLOCK_TYPE_GRASS;
-      } else if (y - start_depth < 2) {
-        chunk->blocks[y][x] = BLOCK_TYPE_DIRT;
-      } else if (y - start_depth < (GRID_Y)) {
-        chunk->blocks[y][x] = (double)((double)rand() / RAND_MAX) > 0.5
-                                  ? BLOCK_TYPE_STONE
-                                  : BLOCK_TYPE_DIRT;
+// Adds the chunks `generator` has finished, then queues any still missing
+// in the band of WORLD_LOAD_RADIUS columns and WORLD_LOAD_RADIUS_Y rows
+// around `position`, nearest ring first.
+fn void world_generate_around(World *world, GeneratorService *generator, Vector2 position) {
+  generator_service_collect(generator, world);
+  int center_x = world_chunk_x(position.x);
+  int center_y = world_chunk_y(position.y);
+  for (int ring = 0; ring <= WORLD_LOAD_RADIUS; ++ring) {
+    for (int dx = -WORLD_LOAD_RADIUS; dx <= WORLD_LOAD_RADIUS; ++dx) {
+      for (int dy = -WORLD_LOAD_RADIUS_Y; dy <= WORLD_LOAD_RADIUS_Y; ++dy) {
+        if ((abs(dx) > abs(dy) ? abs(dx) : abs(dy)) == ring &&
+            !world_has_chunk(world, center_x + dx, center_y + dy)) {
+          generator_service_request(generator, world, center_x + dx, center_y + dy);
+        }
       }
     }
   }
 }
 
-fn void chunk_draw(Chunk *chunk, Texture2D const *textures,
-                              int selected_block_type, Vector2 mouse,
-                              Sound const *sounds) {
-  bool pointer_in_chunk = CheckCollisionPointRec(mouse, chunk->bounds);
-
+// Rebuilds the mesh rows whose blocks changed since the chunk was last
+// drawn, merging neighbouring blocks with the same texture into one run.
+fn void chunk_update_mesh(Chunk *chunk) {
+  uint16_t rows = chunk_dirty_rows(chunk, CHUNK_DIRTY_RENDER);
+  if (!chunk->mesh) {
+    chunk->mesh = malloc(sizeof(ChunkMesh));
+    rows = CHUNK_ALL_ROWS;
+  }
   for (int y = 0; y < GRID_Y; ++y) {
-    for (int x = 0; x < GRID_X; ++x) {
-      Rectangle block_rect = {.x = chunk->bounds.x + x * BLOCK_SIZE_X,
-                              .y = y * BLOCK_SIZE_Y,
-                              .width = BLOCK_SIZE_X,
-                              .height = BLOCK_SIZE_Y};
+    if (!(rows & (1u << y))) {
+      continue;
+    }
+    BlockType row[GRID_X];
+    chunk_get_row(chunk, y, row);
+    int n_runs = 0;
+    for (int x = 0; x < GRID_X;) {
+      int start = x;
+      int texture = block_texture(row[x]);
+      while (x < GRID_X && block_texture(row[x]) == texture) {
+        x++;
+      }
+      if (texture >= 0) { // We don't draw air. DUh!.
+        chunk->mesh->runs[y][n_runs++] = (BlockRun){
+            .x = start,
+            .length = x - start,
+            .texture = texture,
+        };
+      }
+    }
+    chunk->mesh->n_runs[y] = n_runs;
+  }
+  chunk_clear_dirty(chunk, CHUNK_DIRTY_RENDER);
+}
 
-      BlockType block = chunk->blocks[y][x];
-      Texture2D texture = textures[block];
+fn void chunk_draw(Chunk *chunk, Texture2D const *textures) {
+  if (chunk_is_uniform(chunk)) {
+    // A single tiled quad covers the whole chunk; textures wrap by default.
+    int texture_index = block_texture(chunk_uniform_type(chunk));
+    if (texture_index >= 0) {
+      Texture2D texture = textures[texture_index];
       Rectangle texture_rect = {
           .x = 0,
           .y = 0,
-          .width = texture.width,
-          .height = texture.height,
+          .width = texture.width * GRID_X,
+          .height = texture.height * GRID_Y,
       };
-
-      if (block != BLOCK_TYPE_AIR) { // We don't draw air. DUh!.
-        DrawTexturePro(texture, texture_rect, block_rect, Vector2Zero(), 0.0,
+      DrawTexturePro(texture, texture_rect, chunk->bounds, Vector2Zero(), 0.0,
+                     WHITE);
+    }
+  } else {
+    chunk_update_mesh(chunk);
+    for (int y = 0; y < GRID_Y; ++y) {
+      for (int i = 0; i < chunk->mesh->n_runs[y]; ++i) {
+        BlockRun run = chunk->mesh->runs[y][i];
+        Rectangle run_rect = {.x = chunk->bounds.x + run.x * BLOCK_SIZE_X,
+                              .y = chunk->bounds.y + y * BLOCK_SIZE_Y,
+                              .width = run.length * BLOCK_SIZE_X,
+                              .height = BLOCK_SIZE_Y};
+        Texture2D texture = textures[run.texture];
+        Rectangle texture_rect = {
+            .x = 0,
+            .y = 0,
+            .width = texture.width * run.length,
+            .height = texture.height,
+        };
+        DrawTexturePro(texture, texture_rect, run_rect, Vector2Zero(), 0.0,
                        WHITE);
       }
+    }
+  }
+}
 
-      if (pointer_in_chunk && CheckCollisionPointRec(mouse, block_rect)) {
-        DrawRectangle(block_rect.x, block_rect.y, block_rect.width,
-                      block_rect.height, ColorAlpha(YELLOW, 0.25));
-
-        if (IsMouseButtonPressed(MOUSE_BUTTON_LEFT) &&
-            block != BLOCK_TYPE_AIR) {
-          chunk->blocks[y][x] = BLOCK_TYPE_AIR;
-          PlaySound(sounds[0]);
-        } else if (IsMouseButtonPressed(MOUSE_BUTTON_RIGHT) &&
-                   block == BLOCK_TYPE_AIR) {
-          PlaySound(sounds[1]);
-          chunk->blocks[y][x] = selected_block_type;
-        }
-      }
+// Highlights the block under the mouse and breaks or places it on click.
+fn void handle_block_edit(World *world, Vector2 mouse,
+                          BlockType selected_block_type, Sound const *sounds) {
+  int x = world_block_x(mouse.x);
+  int y = world_block_y(mouse.y);
+  if (!world_find_chunk(world, world_block_chunk_x(x), world_block_chunk_y(y))) {
+    return;
+  }
+  Rectangle block_rect = world_block_rect(x, y);
+  BlockType block = world_get_block(world, x, y);
+
+  DrawRectangle(block_rect.x, block_rect.y, block_rect.width,
+                block_rect.height, ColorAlpha(YELLOW, 0.25));
+
+  if (IsMouseButtonPressed(MOUSE_BUTTON_LEFT) && !block_is_replaceable(block)) {
+    world_set_block(world, x, y, BLOCK_TYPE_AIR);
+    int sound = block_registry.break_sound[(BlockId)block];
+    if (sound != BLOCK_SOUND_NONE) {
+      PlaySound(sounds[sound]);
+    }
+  } else if (IsMouseButtonPressed(MOUSE_BUTTON_RIGHT) &&
+             block_is_replaceable(block)) {
+    int sound = block_registry.place_sound[(BlockId)selected_block_type];
+    if (sound != BLOCK_SOUND_NONE) {
+      PlaySound(sounds[sound]);
     }
+    world_set_block(world, x, y, selected_block_type);
   }
 }
 
@@ -203,26 +310,18 @@ fn Texture2D animation_step(Animation *animation) {
   return texture;
 }
 
-fn void check_chunk_collision(Character *character, Chunk *chunks, Rectangle *new_bounds) {
-  int start_x = floor(Clamp(new_bounds->x / BLOCK_SIZE_X, 0, N_CHUNKS * GRID_X));
-  int end_x = ceil(Clamp((new_bounds->x + new_bounds->width) / BLOCK_SIZE_X, 0, N_CHUNKS * GRID_X));
-  int start_y = floor(Clamp(new_bounds->y / BLOCK_SIZE_Y, 0, GRID_Y));
-  int end_y = ceil(Clamp((new_bounds->y + new_bounds->height) / BLOCK_SIZE_Y, 0, GRID_Y));
-
-  for (int abs_x = start_x; abs_x < end_x; abs_x++) {
-    Chunk *chunk = &chunks[abs_x / GRID_X];
-    int x = abs_x - chunk->bounds.x / BLOCK_SIZE_X;
-    for (int abs_y = start_y; abs_y < end_y; abs_y++) {
-      int y = abs_y - chunk->bounds.y;
-      if (chunk->blocks[y][x] == BLOCK_TYPE_AIR) {
+fn void check_chunk_collision(Character *character, World *world, Rectangle *new_bounds) {
+  int start_x = world_block_x(new_bounds->x);
+  int end_x = ceil((new_bounds->x + new_bounds->width) / BLOCK_SIZE_X);
+  int start_y = world_block_y(new_bounds->y);
+  int end_y = ceil((new_bounds->y + new_bounds->height) / BLOCK_SIZE_Y);
+
+  for (int x = start_x; x < end_x; x++) {
+    for (int y = start_y; y < end_y; y++) {
+      if (!block_is_solid(world_get_block(world, x, y))) {
         continue;
       }
-      Rectangle block_rect = {
-          .x = chunk->bounds.x + x * BLOCK_SIZE_X,
-          .y = chunk->bounds.y + y * BLOCK_SIZE_Y,
-          .width = BLOCK_SIZE_X,
-          .height = BLOCK_SIZE_Y,
-      };
+      Rectangle block_rect = world_block_rect(x, y);
 
       Vector2 char_center = {new_bounds->x + new_bounds->width / 2,
                               new_bounds->y + new_bounds->height / 2};
@@ -254,7 +353,7 @@ fn void check_chunk_collision(Character *character, Chunk *chunks, Rectangle *ne
   }
 }
 
-fn void character_physics(Character *character, Chunk *chunks, Vector2 world_size) {
+fn void character_physics(Character *character, World *world) {
   character->velocity.y += GRAVITY;
 
   Rectangle new_bounds = {
@@ -264,12 +363,46 @@ fn void character_physics(Character *character, Chunk *chunks, Vector2 world_siz
     .height = character->size.y
   };
 
-  check_chunk_collision(character, chunks, &new_bounds);
+  check_chunk_collision(character, world, &new_bounds);
 
-  character->position = Vector2Clamp((Vector2){new_bounds.x, new_bounds.y}, Vector2Zero(), world_size);
+  character->position = (Vector2){new_bounds.x, new_bounds.y};
   character->velocity = Vector2Scale(character->velocity, .98f);
 }
 
+// Stands the character on the topmost solid block of its column. Returns
+// false, leaving it where it is, while chunks of that column are still
+// being generated.
+fn bool character_spawn(Character *character, World *world) {
+  int x = world_block_x(character->position.x + character->size.x / 2);
+  for (int cy = -WORLD_LOAD_RADIUS_Y; cy <= WORLD_LOAD_RADIUS_Y; ++cy) {
+    if (!world_has_chunk(world, world_block_chunk_x(x), cy)) {
+      return false;
+    }
+  }
+  int top = 0;
+  if (world_column_top(world, x, -WORLD_LOAD_RADIUS_Y * GRID_Y,
+                       2 * WORLD_LOAD_RADIUS_Y + 1, &top)) {
+    character->position.y = top * BLOCK_SIZE_Y - character->size.y;
+    character->velocity = Vector2Zero();
+  }
+  return true;
+}
+
+// Whether the chunks around the character exist, so that it never falls
+// through one that is still being generated.
+fn bool character_has_ground(Character *character, World *world) {
+  int center_x = world_chunk_x(character->position.x);
+  int center_y = world_chunk_y(character->position.y);
+  for (int cx = center_x - 1; cx <= center_x + 1; ++cx) {
+    for (int cy = center_y - 1; cy <= center_y + 1; ++cy) {
+      if (!world_has_chunk(world, cx, cy)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
 fn Rectangle character_get_bounds(Character *character) {
   return (Rectangle){.x = character->position.x,
                      .y = character->position.y,
@@ -301,33 +434,99 @@ fn void character_draw(Character *character) {
   }
 }
 
-int main(void) {
-  srand(GetTime());
+int main(int argc, char **argv) {
+  // ./main --convert worlds/*.data rewrites legacy text worlds as binary.
+  if (argc > 1 && strcmp(argv[1], "--convert") == 0) {
+    block_registry_init();
+    int failures = 0;
+    for (int i = 2; i < argc; ++i) {
+      failures += !convert_world_file(argv[i]);
+    }
+    return failures != 0;
+  }
+  // ./main --compact worlds/*.data folds save journals back into the file.
+  if (argc > 1 && strcmp(argv[1], "--compact") == 0) {
+    block_registry_init();
+    int failures = 0;
+    for (int i = 2; i < argc; ++i) {
+      failures += !compact_world_file(argv[i]);
+    }
+    return failures != 0;
+  }
+  // ./main --regions worlds/x.data turns world files into region worlds.
+  if (argc > 1 && strcmp(argv[1], "--regions") == 0) {
+    block_registry_init();
+    int failures = 0;
+    for (int i = 2; i < argc; ++i) {
+      failures += !convert_world_to_regions(argv[i]);
+    }
+    return failures != 0;
+  }
+  // ./main --delta worlds/x.data stores worlds as edits against their generator.
+  if (argc > 1 && strcmp(argv[1], "--delta") == 0) {
+    block_registry_init();
+    int failures = 0;
+    for (int i = 2; i < argc; ++i) {
+      failures += !convert_world_to_delta(argv[i]);
+    }
+    return failures != 0;
+  }
+  // ./main --bench-codecs worlds/*.data compares chunk codecs on real worlds.
+  if (argc > 1 && strcmp(argv[1], "--bench-codecs") == 0) {
+    block_registry_init();
+    int failures = 0;
+    for (int i = 2; i < argc; ++i) {
+      failures += !bench_codecs(argv[i]);
+    }
+    return failures != 0;
+  }
+  // ./main --bench-generate checks the noise kernels and times generation.
+  if (argc > 1 && strcmp(argv[1], "--bench-generate") == 0) {
+    block_registry_init();
+    return !bench_generate();
+  }
+  // ./main --bench-text worlds/*.data times the text reader against fscanf.
+  if (argc > 1 && strcmp(argv[1], "--bench-text") == 0) {
+    block_registry_init();
+    int failures = 0;
+    for (int i = 2; i < argc; ++i) {
+      failures += !bench_text(argv[i]);
+    }
+    return failures != 0;
+  }
 
   SetConfigFlags(FLAG_WINDOW_RESIZABLE | FLAG_WINDOW_MAXIMIZED);
   InitWindow(SCREEN_WIDTH, SCREEN_HEIGHT, "Block Break");
   InitAudioDevice();
   SetTargetFPS(60);
 
-  const Texture2D textures[] = {
-      LoadTexture("assets/grass.jpg"),
-      LoadTexture("assets/dirt.jpg"),
-      LoadTexture("assets/stone.jpg"),
-  };
+  block_registry_init();
 
-  const Sound sounds[] = {
-      LoadSound("assets/crunch.wav"),
-      LoadSound("assets/place.wav"),
-  };
+  Texture2D textures[BLOCK_ID_COUNT];
+  for (int i = 0; i < block_registry.n_textures; ++i) {
+    textures[i] = LoadTexture(block_registry.texture_paths[i]);
+  }
+
+  Sound sounds[BLOCK_MAX_SOUNDS];
+  for (size_t i = 0; i < sizeof(BLOCK_SOUND_PATHS) / sizeof(BLOCK_SOUND_PATHS[0]); ++i) {
+    sounds[i] = LoadSound(BLOCK_SOUND_PATHS[i]);
+  }
 
-  int selected_block_type = BLOCK_TYPE_STONE;
+  // Index into block_registry.placeable.
+  int selected_block = block_registry.n_placeable - 1;
   double ui_action_last_time = 0.0f;
   Camera2D camera = {0};
   camera.rotation = 0.0;
   camera.target = (Vector2){0, 0};
   camera.zoom = 1.0;
 
-  Chunk chunks[24];
+  World world = {0};
+  world_init(&world);
+
+  SaveService saver;
+  save_service_start(&saver);
+  GeneratorService generator;
+  generator_service_start(&generator);
 
   char *filename = nullptr;
 
@@ -339,11 +538,6 @@ int main(void) {
     .animation = load_animation("assets/character_animation")
   };
 
-  Vector2 world_size = {
-      BLOCK_SIZE_X * GRID_X * N_CHUNKS,
-      BLOCK_SIZE_Y * GRID_Y,
-  };
-
 reset_world:
   character.position = (Vector2){0,0};
   if (filename) {
@@ -351,24 +545,43 @@ reset_world:
   }
   bool result = select_filename(&filename);
 
-  if (result) {
-    for (int i = 0; i < 24; ++i) {
-      float x_offset = i * (BLOCK_SIZE_X * GRID_X);
-      chunk_generate(&chunks[i], x_offset);
+  world_clear(&world);
+  generator_service_cancel(&generator);
+  world.generator = GENERATOR_VERSION;
+  // Legacy text worlds do not store a camera target and leave this one.
+  camera.target = Vector2Zero();
+  bool loaded = !result && filename && FileExists(filename);
+  if (loaded) {
+    // Loading a world that records its seed replaces this one; older worlds
+    // get the same seed every session so their new chunks stay consistent.
+    world.seed = 0;
+    if (!stream_world_from_file(&camera, &world, filename)) {
+      return 1;
     }
-    save_new_world(&camera, chunks, &filename);
+    // The camera follows the character, so it was saved where it stood.
+    character.position = camera.target;
+    world_stream_step(&world, character.position, 0.0);
+    world_generate_around(&world, &generator, character.position);
   } else {
-    if (filename && FileExists(filename)) {
-      read_world_from_file(&camera, chunks, filename);
-    } else {
-      for (int i = 0; i < 24; ++i) {
-        float x_offset = i * (BLOCK_SIZE_X * GRID_X);
-        chunk_generate(&chunks[i], x_offset);
-      }
-    }
+    world.seed = generator_mix((uint64_t)time(NULL) ^ (uint64_t)(GetTime() * 1e9));
+    world_generate_around(&world, &generator, character.position);
   }
+  world_footprint_report(&world);
+  // The character waits for the chunks under it to be generated and is then
+  // stood on the surface, unless the world saved where it stood.
+  bool spawned = loaded && !Vector2Equals(character.position, Vector2Zero());
+  // The camera as last saved; leaving saves it if it moved.
+  Camera2D saved_camera = camera;
+  // A new world is named and saved for the first time once the area around
+  // the spawn is generated, so the file and its catalog thumbnail show it.
+  bool unnamed = result;
 
   while (!WindowShouldClose()) {
+    if (unnamed && spawned && generator.n_pending == 0) {
+      unnamed = false;
+      save_new_world(&saver, &camera, &world, &filename);
+      saved_camera = camera;
+    }
     BeginDrawing();
     BeginMode2D(camera);
     ClearBackground(SKYBLUE);
@@ -379,12 +592,32 @@ reset_world:
 
     // Update game.
     Vector2 mouse = GetScreenToWorld2D(GetMousePosition(), camera);
-    character_physics(&character, chunks, world_size);
+    world_stream_step(&world, character.position, WORLD_STREAM_FRAME_BUDGET);
+    world_generate_around(&world, &generator, character.position);
+    if (!spawned) {
+      spawned = character_spawn(&character, &world);
+    } else if (character_has_ground(&character, &world)) {
+      character_physics(&character, &world);
+    }
     character_draw(&character);
-    for (int i = 0; i < N_CHUNKS; ++i) {
-      Chunk *chunk = &chunks[i];
-      chunk_draw(chunk, textures, selected_block_type, mouse, sounds);
+    Vector2 view_min = GetScreenToWorld2D(Vector2Zero(), camera);
+    Vector2 view_max = GetScreenToWorld2D(
+        (Vector2){GetScreenWidth(), GetScreenHeight()}, camera);
+    for (int cx = world_chunk_x(view_min.x); cx <= world_chunk_x(view_max.x);
+         ++cx) {
+      for (int cy = world_chunk_y(view_min.y);
+           cy <= world_chunk_y(view_max.y); ++cy) {
+        Chunk *chunk = world_find_chunk(&world, cx, cy);
+        if (chunk) {
+          chunk_draw(chunk, textures);
+          // Drawing may have built its mesh.
+          world_account(&world, chunk);
+        }
+      }
     }
+    handle_block_edit(&world, mouse, block_registry.placeable[selected_block],
+                      sounds);
+    world_trim(&world, character.position);
     camera.target = character.position;
     camera.offset = (Vector2){GetScreenWidth() / 2.0, GetScreenHeight() / 2.0};
 
@@ -417,7 +650,8 @@ reset_world:
       if (IsKeyDown(KEY_LEFT_CONTROL) && IsKeyPressed(KEY_S)) {
         EndMode2D();
         EndDrawing();
-        save_new_world(&camera, chunks, &filename);
+        save_new_world(&saver, &camera, &world, &filename);
+        saved_camera = camera;
       }
 
       int scroll = GetMouseWheelMove();
@@ -426,8 +660,9 @@ reset_world:
           camera.zoom += (float)scroll / 100;
         }
         ui_action_last_time = GetTime();
-        selected_block_type -= scroll;
-        selected_block_type = Clamp(selected_block_type, 0, BLOCK_TYPE_STONE);
+        selected_block -= scroll;
+        selected_block =
+            Clamp(selected_block, 0, block_registry.n_placeable - 1);
       }
     }
 
@@ -444,8 +679,9 @@ reset_world:
           camera);
 
       if (delta < 1.0) {
-        for (int i = 0; i < 3; ++i) {
-          Texture2D texture = textures[i];
+        for (int i = 0; i < block_registry.n_placeable; ++i) {
+          BlockType block = block_registry.placeable[i];
+          Texture2D texture = textures[block_texture(block)];
           Rectangle texture_rect = {
               .x = 0,
               .y = 0,
@@ -464,15 +700,10 @@ reset_world:
                         WHITE);
 
           Color color = BLACK;
-          if (i == selected_block_type) {
-            static char *names[3] = {
-                "Grass",
-                "Dirt",
-                "Stone",
-            };
+          if (i == selected_block) {
             color = WHITE;
 
-            DrawText(names[i], ui_start_position.x,
+            DrawText(block_name(block), ui_start_position.x,
                     ui_start_position.y - ELEMENT_SIZE / 2, 16, WHITE);
           }
           DrawRectangleLines(ui_start_position.x, ui_start_position.y,
@@ -483,14 +714,27 @@ reset_world:
     }
 
     EndMode2D();
+    save_service_poll(&saver, &world);
+    draw_save_progress(&saver);
     EndDrawing();
   }
 
-  if (filename) {
-    char buffer[1024];
-    snprintf(buffer, 1024, "worlds/%s", filename);
-    write_world_to_file(&camera, chunks, buffer);
+  bool camera_moved = !Vector2Equals(camera.target, saved_camera.target) ||
+                      !Vector2Equals(camera.offset, saved_camera.offset);
+  if (filename && (world_is_dirty(&world) || camera_moved)) {
+    save_service_save(&saver, &camera, &world, filename);
+  }
+  // Keep drawing while the last saves finish so the window does not hang.
+  float progress = 0.0f;
+  while (save_service_progress(&saver, &progress)) {
+    BeginDrawing();
+    ClearBackground(BLACK);
+    draw_save_progress(&saver);
+    EndDrawing();
   }
+  save_service_stop(&saver);
+  generator_service_stop(&generator);
+  world_footprint_report(&world);
 
   return 0;
 }
\ No newline at end of file